@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "banker.h"
+
+static int* alloc_vecs(int num_ints) {
+  int* ptr = NULL;
+  if (posix_memalign((void**) &ptr, sizeof(banker_vec), sizeof(int) * num_ints) != 0) {
+    perror("Failed to allocate banker's matrices");
+    exit(EXIT_FAILURE);
+  }
+  memset(ptr, 0, sizeof(int) * num_ints);
+  return ptr;
+}
+
+static int* row(struct banker* b, int* matrix, int pid) {
+  return matrix + pid * b->stride;
+}
+
+/**
+ * Initializes the banker's state with no declared claims.
+ *
+ * @param b The banker
+ * @param num_procs Number of process IDs
+ * @param num_res Number of resources
+ * @param avail Number of instances of each resource
+ */
+void init_banker(struct banker* b, int num_procs, int num_res, const int* avail) {
+  b->num_procs = num_procs;
+  b->num_res = num_res;
+  b->stride = (num_res + BANKER_LANES - 1) / BANKER_LANES * BANKER_LANES;
+  b->alloc = alloc_vecs(num_procs * b->stride);
+  b->need = alloc_vecs(num_procs * b->stride);
+  b->avail = alloc_vecs(b->stride);
+  b->work = alloc_vecs(b->stride);
+  b->active = alloc_vecs(num_procs);
+  b->finished = alloc_vecs(num_procs);
+  b->num_active = 0;
+  memcpy(b->avail, avail, sizeof(int) * num_res);
+}
+
+void free_banker(struct banker* b) {
+  free(b->alloc);
+  free(b->need);
+  free(b->avail);
+  free(b->work);
+  free(b->active);
+  free(b->finished);
+}
+
+/**
+ * Records the maximum claim of a process.
+ *
+ * @param b The banker
+ * @param pid The process declaring its claim
+ * @param max_claim Most instances of each resource it will ever hold
+ */
+void declare_claim(struct banker* b, int pid, const int* max_claim) {
+  memcpy(row(b, b->need, pid), max_claim, sizeof(int) * b->num_res);
+  memset(row(b, b->alloc, pid), 0, sizeof(int) * b->num_res);
+  b->active[b->num_active++] = pid;
+}
+
+/**
+ * @return Nonzero if granting the request would exceed the process's claim.
+ */
+int exceeds_claim(struct banker* b, int pid, int res_type) {
+  return row(b, b->need, pid)[res_type] <= 0;
+}
+
+/**
+ * @return Nonzero if need <= work in every lane.
+ */
+static int can_finish(const int* need, const int* work, int stride) {
+  const banker_vec* n = (const banker_vec*) need;
+  const banker_vec* w = (const banker_vec*) work;
+  banker_vec over = { 0 };
+  int i = 0;
+  for (; i < stride / BANKER_LANES; i++) {
+    over |= n[i] > w[i];
+  }
+  for (i = 0; i < BANKER_LANES; i++) {
+    if (over[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Runs the safety check: is there an order in which every active
+ * process can get its full claim and finish?
+ */
+static int is_safe(struct banker* b) {
+  banker_vec* work = (banker_vec*) b->work;
+  const banker_vec* avail = (const banker_vec*) b->avail;
+  int num_vecs = b->stride / BANKER_LANES;
+  int i = 0;
+  for (; i < num_vecs; i++) {
+    work[i] = avail[i];
+  }
+
+  // Swap finished processes to the front so each pass only walks
+  // the ones that haven't finished yet
+  memcpy(b->finished, b->active, sizeof(int) * b->num_active);
+  int* order = b->finished;
+  int num_done = 0;
+  int progress = 1;
+  while (progress && num_done < b->num_active) {
+    progress = 0;
+    for (i = num_done; i < b->num_active; i++) {
+      int pid = order[i];
+      if (can_finish(row(b, b->need, pid), b->work, b->stride)) {
+        const banker_vec* alloc = (const banker_vec*) row(b, b->alloc, pid);
+        int j = 0;
+        for (; j < num_vecs; j++) {
+          work[j] += alloc[j];
+        }
+        order[i] = order[num_done];
+        order[num_done++] = pid;
+        progress = 1;
+      }
+    }
+  }
+
+  return num_done == b->num_active;
+}
+
+/**
+ * Checks whether granting one instance of a resource leaves the
+ * system in a safe state. The state is left unchanged.
+ *
+ * @param b The banker
+ * @param pid The requesting process
+ * @param res_type The requested resource
+ * @return Nonzero if the grant is safe.
+ */
+int is_safe_to_grant(struct banker* b, int pid, int res_type) {
+  if (b->avail[res_type] <= 0) {
+    return 0;
+  }
+  banker_grant(b, pid, res_type);
+  int safe = is_safe(b);
+  banker_release(b, pid, res_type);
+  return safe;
+}
+
+/**
+ * @return How many more instances of a resource the process's
+ *         claim allows it.
+ */
+int get_remaining_claim(struct banker* b, int pid, int res_type) {
+  return row(b, b->need, pid)[res_type];
+}
+
+/**
+ * Adds a set of instances to, or takes them back from, a process's
+ * allocation.
+ */
+static void adjust_allocation(struct banker* b, int pid, const int* counts, int sign) {
+  int* alloc = row(b, b->alloc, pid);
+  int* need = row(b, b->need, pid);
+  int i = 0;
+  for (; i < b->num_res; i++) {
+    b->avail[i] -= sign * counts[i];
+    alloc[i] += sign * counts[i];
+    need[i] -= sign * counts[i];
+  }
+}
+
+/**
+ * Checks whether granting a set of instances all at once leaves
+ * the system in a safe state. The state is left unchanged.
+ *
+ * @param b The banker
+ * @param pid The requesting process
+ * @param counts Instances requested of each resource
+ * @return Nonzero if the grant is safe.
+ */
+int is_safe_to_grant_set(struct banker* b, int pid, const int* counts) {
+  int i = 0;
+  for (; i < b->num_res; i++) {
+    if (counts[i] > b->avail[i]) {
+      return 0;
+    }
+  }
+  adjust_allocation(b, pid, counts, 1);
+  int safe = is_safe(b);
+  adjust_allocation(b, pid, counts, -1);
+  return safe;
+}
+
+void banker_grant(struct banker* b, int pid, int res_type) {
+  b->avail[res_type]--;
+  row(b, b->alloc, pid)[res_type]++;
+  row(b, b->need, pid)[res_type]--;
+}
+
+void banker_release(struct banker* b, int pid, int res_type) {
+  b->avail[res_type]++;
+  row(b, b->alloc, pid)[res_type]--;
+  row(b, b->need, pid)[res_type]++;
+}
+
+/**
+ * Returns everything a process holds and forgets its claim.
+ *
+ * @param b The banker
+ * @param pid The terminating process
+ */
+void banker_release_all(struct banker* b, int pid) {
+  int* alloc = row(b, b->alloc, pid);
+  int i = 0;
+  for (; i < b->num_res; i++) {
+    b->avail[i] += alloc[i];
+  }
+  memset(alloc, 0, sizeof(int) * b->stride);
+  memset(row(b, b->need, pid), 0, sizeof(int) * b->stride);
+
+  for (i = 0; i < b->num_active; i++) {
+    if (b->active[i] == pid) {
+      b->active[i] = b->active[--b->num_active];
+      break;
+    }
+  }
+}
@@ -0,0 +1,38 @@
+#ifndef BANKER_H
+#define BANKER_H
+
+// Ints per SIMD vector. Matrix rows are padded to a multiple of this.
+#define BANKER_LANES 4
+
+typedef int banker_vec __attribute__((vector_size(BANKER_LANES * sizeof(int))));
+
+/*
+ * State for the banker's algorithm. Allocation and Need are dense
+ * row-major matrices with one row per process, so the safety check
+ * walks contiguous memory a vector at a time.
+ * -----------------------------------------------------------------*/
+struct banker {
+  int num_procs;
+  int num_res;
+  int stride;         // Row length in ints, padded to BANKER_LANES
+  int* alloc;         // Allocation: instances each process holds
+  int* need;          // Need: maximum claim minus allocation
+  int* avail;         // Available: free instances of each resource
+  int* work;          // Scratch space for the safety check
+  int* active;        // IDs of processes with a declared claim
+  int* finished;      // Scratch space for the safety check
+  int num_active;
+};
+
+void init_banker(struct banker* b, int num_procs, int num_res, const int* avail);
+void free_banker(struct banker* b);
+void declare_claim(struct banker* b, int pid, const int* max_claim);
+int exceeds_claim(struct banker* b, int pid, int res_type);
+int get_remaining_claim(struct banker* b, int pid, int res_type);
+int is_safe_to_grant(struct banker* b, int pid, int res_type);
+int is_safe_to_grant_set(struct banker* b, int pid, const int* counts);
+void banker_grant(struct banker* b, int pid, int res_type);
+void banker_release(struct banker* b, int pid, int res_type);
+void banker_release_all(struct banker* b, int pid);
+
+#endif
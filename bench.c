@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include "bench.h"
+
+/**
+ * Prints a benchmark result.
+ *
+ * @param name Name of the benchmark
+ * @param params Its parameters as key=value pairs
+ * @param num_ops Number of operations timed
+ * @param elapsed_ns Nanoseconds they took
+ * @param latency Latency of each operation in nanoseconds, or NULL
+ */
+void report_bench(const char* name,
+                  const char* params,
+                  uint64_t num_ops,
+                  uint64_t elapsed_ns,
+                  struct histogram* latency) {
+  printf("bench=%s %s ops=%lu ops/sec=%.0f ns/op=%.1f",
+         name,
+         params,
+         num_ops,
+         num_ops / (elapsed_ns / 1e9),
+         (double) elapsed_ns / num_ops);
+  if (latency != NULL) {
+    printf(" p50_ns=%lu p99_ns=%lu",
+           get_percentile(latency, 50),
+           get_percentile(latency, 99));
+  }
+  printf("\n");
+  fflush(stdout);
+}
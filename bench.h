@@ -0,0 +1,21 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include "metrics.h"
+#include "myclock.h"
+
+/*
+ * Helpers shared by the benchmarks. Every benchmark reports one line
+ * per result as space separated key=value pairs, starting with
+ * bench=<name>, so results can be collected and compared by script.
+ * Time them with read_wall_nanosecs() from myclock.h.
+ * --------------------------------------------------------------------*/
+
+void report_bench(const char* name,
+                  const char* params,
+                  uint64_t num_ops,
+                  uint64_t elapsed_ns,
+                  struct histogram* latency);
+
+#endif
@@ -0,0 +1,256 @@
+/**
+ * Benchmarks for the allocation core on its own: finding a free
+ * instance, granting and releasing one, releasing everything a
+ * process holds, and deadlock detection over a blocked system.
+ *
+ * Operations cheaper than reading the clock are timed in batches,
+ * and each batch's average goes into the latency histogram.
+ *
+ * Usage: bench_alloc [num_procs] [num_res] [max_instances] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "cacheline.h"
+#include "deadlock.h"
+#include "resource.h"
+
+#define BATCH 64
+#define NUM_RANDS (1 << 16)
+
+static int num_procs;
+static int num_res;
+static int max_instances;
+static int iterations;
+
+static struct res_node* res_list;
+static struct proc_node* proc_list;
+static struct hold* holds;
+static int* rands;
+static char params[128];
+
+static void* alloc_or_die(size_t size) {
+  void* ptr;
+  if (posix_memalign(&ptr, CACHE_LINE_SIZE, size) != 0) {
+    perror("Failed to allocate");
+    exit(EXIT_FAILURE);
+  }
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+/**
+ * Lays out resources with 1 to max_instances instances each and
+ * processes holding nothing.
+ */
+static void setup(void) {
+  int* num_instances = alloc_or_die(sizeof(int) * num_res);
+  int total_instances = 0;
+  int i = 0;
+  for (; i < num_res; i++) {
+    num_instances[i] = rand() % max_instances + 1;
+    total_instances += num_instances[i];
+  }
+
+  init_layout(num_res, max_instances, num_procs);
+  res_list = alloc_or_die(get_res_list_size(total_instances));
+  proc_list = alloc_or_die(get_proc_list_size());
+  holds = get_hold_table(res_list);
+
+  unsigned int first_instance = 0;
+  for (i = 0; i < num_res; i++) {
+    struct res_node* res = get_res(res_list, i);
+    res->type = i;
+    res->num_instances = num_instances[i];
+    init_res_instances(res, first_instance, holds);
+    first_instance += res->num_instances;
+  }
+  for (i = 0; i < num_procs; i++) {
+    struct proc_node* proc = get_proc(proc_list, i);
+    proc->id = i;
+    proc->request = -1;
+    proc->num_holds = 0;
+    proc->last_hold = -1;
+  }
+  free(num_instances);
+}
+
+static void release_everything(void) {
+  int released_res[num_res];
+  int i = 0;
+  for (; i < num_procs; i++) {
+    drop_all_holds(get_proc(proc_list, i), res_list, released_res);
+  }
+}
+
+/**
+ * Hands out instances to random processes until every resource
+ * is used up.
+ */
+static void allocate_everything(void) {
+  int r = 0;
+  for (; r < num_res; r++) {
+    struct res_node* res = get_res(res_list, r);
+    while (res->num_allocated < res->num_instances) {
+      add_hold(get_proc(proc_list, rand() % num_procs), res, holds);
+    }
+  }
+}
+
+static void bench_get_res_instance(void) {
+  struct histogram latency = { 0 };
+  volatile int sink = 0;
+  uint64_t total = 0;
+  int i = 0;
+
+  // Leave about half of each resource allocated
+  int r = 0;
+  for (; r < num_res; r++) {
+    struct res_node* res = get_res(res_list, r);
+    while (res->num_allocated < res->num_instances / 2) {
+      add_hold(get_proc(proc_list, rand() % num_procs), res, holds);
+    }
+  }
+
+  for (; i < iterations; i += BATCH) {
+    uint64_t start = read_wall_nanosecs();
+    int j = 0;
+    for (; j < BATCH; j++) {
+      sink += get_res_instance(get_res(res_list, rands[(i + j) % NUM_RANDS] % num_res));
+    }
+    uint64_t elapsed = read_wall_nanosecs() - start;
+    record_value(&latency, elapsed / BATCH);
+    total += elapsed;
+  }
+  report_bench("get_res_instance", params, latency.count * BATCH, total, &latency);
+  release_everything();
+}
+
+/**
+ * A random process asks for a random resource, and either gets it
+ * or gives back its most recent hold, the way oss sees the stream
+ * of requests and releases.
+ */
+static void bench_grant_release(void) {
+  struct histogram latency = { 0 };
+  uint64_t total = 0;
+  int i = 0;
+
+  for (; i < iterations; i += BATCH) {
+    uint64_t start = read_wall_nanosecs();
+    int j = 0;
+    for (; j < BATCH; j++) {
+      int rand_value = rands[(i + j) % NUM_RANDS];
+      struct proc_node* proc = get_proc(proc_list, rand_value % num_procs);
+      struct res_node* res = get_res(res_list, (rand_value / num_procs) % num_res);
+      if ((rand_value & 1 || add_hold(proc, res, holds) == -1) &&
+          proc->num_holds > 0) {
+        drop_last_hold(proc, get_res(res_list, holds[proc->last_hold].res_type), holds);
+      }
+    }
+    uint64_t elapsed = read_wall_nanosecs() - start;
+    record_value(&latency, elapsed / BATCH);
+    total += elapsed;
+  }
+  report_bench("grant_release", params, latency.count * BATCH, total, &latency);
+  release_everything();
+}
+
+/**
+ * Releases everything a process holds, as when it terminates or
+ * is killed, after handing out every instance.
+ */
+static void bench_release_all(void) {
+  struct histogram latency = { 0 };
+  int released_res[num_res];
+  uint64_t total = 0;
+  uint64_t num_ops = 0;
+  int i = 0;
+
+  while (num_ops < (uint64_t) iterations / BATCH) {
+    allocate_everything();
+    for (i = 0; i < num_procs; i++) {
+      uint64_t start = read_wall_nanosecs();
+      drop_all_holds(get_proc(proc_list, i), res_list, released_res);
+      uint64_t elapsed = read_wall_nanosecs() - start;
+      record_value(&latency, elapsed);
+      total += elapsed;
+      num_ops++;
+    }
+  }
+  report_bench("release_all", params, num_ops, total, &latency);
+}
+
+/**
+ * Runs deadlock detection with every instance handed out, and every
+ * holder and a quarter of the other processes blocked on a random
+ * resource.
+ */
+static void bench_find_deadlocked(void) {
+  struct histogram latency = { 0 };
+  struct wait_graph graph;
+  int* deadlocked = alloc_or_die(sizeof(int) * num_procs);
+  uint64_t total = 0;
+  int num_found = 0;
+  int i = 0;
+
+  init_wait_graph(&graph, res_list, proc_list, num_procs, num_res);
+  allocate_everything();
+  for (; i < num_procs; i++) {
+    if (get_proc(proc_list, i)->num_holds > 0 || i % 4 == 0) {
+      add_waiter(&graph, i, rand() % num_res);
+    }
+  }
+
+  int num_runs = iterations / BATCH > 0 ? iterations / BATCH : 1;
+  for (i = 0; i < num_runs; i++) {
+    uint64_t start = read_wall_nanosecs();
+    num_found = find_deadlocked(&graph, res_list, proc_list, deadlocked);
+    uint64_t elapsed = read_wall_nanosecs() - start;
+    record_value(&latency, elapsed);
+    total += elapsed;
+  }
+
+  char detect_params[160];
+  snprintf(detect_params, sizeof(detect_params), "%s deadlocked=%d", params, num_found);
+  report_bench("find_deadlocked", detect_params, num_runs, total, &latency);
+
+  release_everything();
+  free_wait_graph(&graph);
+  free(deadlocked);
+}
+
+int main(int argc, char* argv[]) {
+  num_procs     = argc > 1 ? atoi(argv[1]) : 256;
+  num_res       = argc > 2 ? atoi(argv[2]) : 20;
+  max_instances = argc > 3 ? atoi(argv[3]) : 10;
+  iterations    = argc > 4 ? atoi(argv[4]) : 1000000;
+
+  if (num_procs < 1 || num_res < 1 || max_instances < 1 || iterations < 1) {
+    fprintf(stderr, "Usage: %s [num_procs] [num_res] [max_instances] [iterations]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  srand(1);
+  rands = alloc_or_die(sizeof(int) * NUM_RANDS);
+  int i = 0;
+  for (; i < NUM_RANDS; i++) {
+    rands[i] = rand();
+  }
+
+  snprintf(params, sizeof(params), "procs=%d res=%d instances=%d",
+           num_procs, num_res, max_instances);
+
+  setup();
+  bench_get_res_instance();
+  bench_grant_release();
+  bench_release_all();
+  bench_find_deadlocked();
+
+  free(rands);
+  free(res_list);
+  free(proc_list);
+  return EXIT_SUCCESS;
+}
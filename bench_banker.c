@@ -0,0 +1,72 @@
+/**
+ * Benchmark for the banker's algorithm safety check.
+ *
+ * Usage: bench_banker [num_procs] [num_res] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "banker.h"
+#include "bench.h"
+
+#define MAX_INSTANCES 10
+
+int main(int argc, char* argv[]) {
+  int num_procs  = argc > 1 ? atoi(argv[1]) : 256;
+  int num_res    = argc > 2 ? atoi(argv[2]) : 20;
+  int iterations = argc > 3 ? atoi(argv[3]) : 100000;
+
+  srand(1);
+
+  int* avail = malloc(sizeof(int) * num_res);
+  int* claim = malloc(sizeof(int) * num_res);
+  int i = 0;
+  for (; i < num_res; i++) {
+    avail[i] = rand() % MAX_INSTANCES + 1;
+  }
+
+  struct banker b;
+  init_banker(&b, num_procs, num_res, avail);
+  for (i = 0; i < num_procs; i++) {
+    int j = 0;
+    for (; j < num_res; j++) {
+      claim[j] = rand() % (avail[j] + 1);
+    }
+    declare_claim(&b, i, claim);
+  }
+
+  // Run requests against a live state, granting the safe ones
+  int num_checks = 0;
+  int num_safe = 0;
+  uint64_t start = read_wall_nanosecs();
+  for (i = 0; i < iterations; i++) {
+    int pid = rand() % num_procs;
+    int res_type = rand() % num_res;
+    if (exceeds_claim(&b, pid, res_type)) {
+      continue;
+    }
+    num_checks++;
+    if (is_safe_to_grant(&b, pid, res_type)) {
+      banker_grant(&b, pid, res_type);
+      num_safe++;
+    } else if (b.avail[res_type] == 0) {
+      // Keep the state moving by letting someone finish
+      banker_release_all(&b, pid);
+      int j = 0;
+      for (; j < num_res; j++) {
+        claim[j] = rand() % (avail[j] + 1);
+      }
+      declare_claim(&b, pid, claim);
+    }
+  }
+  uint64_t elapsed = read_wall_nanosecs() - start;
+
+  char params[96];
+  snprintf(params, sizeof(params), "procs=%d res=%d safe=%d", num_procs, num_res, num_safe);
+  report_bench("banker_safety_check", params, num_checks, elapsed, NULL);
+
+  free_banker(&b);
+  free(avail);
+  free(claim);
+  return EXIT_SUCCESS;
+}
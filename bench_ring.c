@@ -0,0 +1,107 @@
+/**
+ * Benchmark for cross-process traffic on the action ring and
+ * process list, the shared memory oss and its children hit hardest.
+ *
+ * Each producer process repeatedly enqueues a request and polls its
+ * own process node until the consumer answers it, the same round
+ * trip user makes. Built twice: bench_ring with the cache line
+ * padding, and bench_ring_packed without it, so the two can be
+ * compared under `make perf`.
+ *
+ * Usage: bench_ring [num_producers] [round_trips]
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "ring.h"
+#include "resource.h"
+
+#define NUM_RES 20
+#define MAX_INSTANCES 10
+
+#ifdef NO_CACHE_PADDING
+#define LAYOUT "packed"
+#else
+#define LAYOUT "padded"
+#endif
+
+static void* map_shared(size_t size) {
+  void* shm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shm == MAP_FAILED) {
+    perror("Failed to map shared memory");
+    exit(EXIT_FAILURE);
+  }
+  return shm;
+}
+
+static void run_producer(struct action_ring* ring,
+                         struct proc_node* proc_list,
+                         int pid,
+                         int round_trips) {
+  struct proc_node* proc = get_proc(proc_list, pid);
+  int i = 0;
+  for (; i < round_trips; i++) {
+    int seq = atomic_load(&proc->wake_seq);
+    struct proc_action action = { pid, i % NUM_RES, REQUEST };
+    enqueue_action(ring, action);
+    while (atomic_load(&proc->wake_seq) == seq) {
+      sched_yield();
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int num_producers = argc > 1 ? atoi(argv[1]) : 4;
+  int round_trips   = argc > 2 ? atoi(argv[2]) : 100000;
+
+  init_layout(NUM_RES, MAX_INSTANCES, num_producers);
+
+  struct action_ring* ring = map_shared(sizeof(struct action_ring));
+  struct proc_node* proc_list = map_shared(get_proc_list_size());
+  init_action_ring(ring);
+
+  uint64_t start = read_wall_nanosecs();
+
+  int i = 0;
+  for (; i < num_producers; i++) {
+    pid_t child = fork();
+    if (child == -1) {
+      perror("Failed to fork");
+      exit(EXIT_FAILURE);
+    }
+    if (child == 0) {
+      run_producer(ring, proc_list, i, round_trips);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+
+  // Answer every request by bumping the requester's wake sequence
+  long total = (long) num_producers * round_trips;
+  long num_answered = 0;
+  struct proc_action action;
+  while (num_answered < total) {
+    if (dequeue_action(ring, &action) == -1) {
+      sched_yield();
+      continue;
+    }
+    atomic_fetch_add(&get_proc(proc_list, action.pid)->wake_seq, 1);
+    num_answered++;
+  }
+
+  uint64_t elapsed = read_wall_nanosecs() - start;
+  while (wait(NULL) > 0);
+
+  char params[64];
+  snprintf(params, sizeof(params), "layout=%s producers=%d", LAYOUT, num_producers);
+  report_bench("ring_round_trip", params, total, elapsed, NULL);
+
+  munmap(ring, sizeof(struct action_ring));
+  munmap(proc_list, get_proc_list_size());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binlog.h"
+#include "cacheline.h"
+#include "futex.h"
+
+// Must be a power of two
+#define BINLOG_CAPACITY (1 << 16)
+#define BINLOG_MASK (BINLOG_CAPACITY - 1)
+
+// Wake the writer whenever this many records are waiting
+#define BINLOG_WAKE_EVERY (BINLOG_CAPACITY / 4)
+
+// Longest the writer sleeps before checking for records anyway
+#define WRITER_PERIOD 10000000  // 10 ms in nanoseconds
+
+/*
+ * Single-producer / single-consumer ring of records. oss appends
+ * at head, the writer thread writes out from tail.
+ */
+static struct log_record* records;
+static CACHE_ALIGNED atomic_uint head;
+static CACHE_ALIGNED atomic_uint tail;
+static CACHE_ALIGNED atomic_int wake;
+static atomic_int stopping;
+
+static FILE* log_fp;
+static pthread_t writer;
+
+static void wake_writer(void) {
+  atomic_fetch_add(&wake, 1);
+  futex_wake(&wake, 1);
+}
+
+/**
+ * Writes records out as they arrive until the log is closed.
+ */
+static void* write_log(void* arg) {
+  unsigned int pos = atomic_load_explicit(&tail, memory_order_relaxed);
+
+  while (1) {
+    int seen = atomic_load(&wake);
+    int stop = atomic_load(&stopping);
+    unsigned int end = atomic_load_explicit(&head, memory_order_acquire);
+
+    if (end != pos) {
+      // Write up to the end of the ring in one go
+      unsigned int first = pos & BINLOG_MASK;
+      unsigned int num = end - pos;
+      if (num > BINLOG_CAPACITY - first) {
+        num = BINLOG_CAPACITY - first;
+      }
+      fwrite(records + first, sizeof(struct log_record), num, log_fp);
+      pos += num;
+      atomic_store_explicit(&tail, pos, memory_order_release);
+      continue;
+    }
+
+    if (stop) {
+      break;
+    }
+
+    fflush(log_fp);
+    futex_wait_for(&wake, seen, WRITER_PERIOD);
+  }
+
+  return NULL;
+}
+
+/**
+ * Opens the binary log and starts its writer thread.
+ *
+ * @param path The log file
+ * @param num_res Number of resources in the simulation
+ * @return 0 on success. -1 on error.
+ */
+int open_binlog(const char* path, int num_res) {
+  // Close-on-exec, so children don't inherit the log
+  log_fp = fopen(path, "we");
+  if (log_fp == NULL) {
+    return -1;
+  }
+
+  struct binlog_header header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, BINLOG_MAGIC, sizeof(header.magic));
+  header.num_res = num_res;
+  header.record_size = sizeof(struct log_record);
+  fwrite(&header, sizeof(header), 1, log_fp);
+
+  records = malloc(sizeof(struct log_record) * BINLOG_CAPACITY);
+  atomic_init(&head, 0);
+  atomic_init(&tail, 0);
+  atomic_init(&wake, 0);
+  atomic_init(&stopping, 0);
+
+  // Signals are for oss's main thread, never the writer
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int error = pthread_create(&writer, NULL, write_log, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (error != 0) {
+    fclose(log_fp);
+    free(records);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Appends a record to the log. Only one thread may call this.
+ * Never blocks unless the writer has fallen a whole ring behind.
+ *
+ * @param record The record
+ */
+void append_log(struct log_record record) {
+  unsigned int pos = atomic_load_explicit(&head, memory_order_relaxed);
+
+  while (pos - atomic_load_explicit(&tail, memory_order_acquire) == BINLOG_CAPACITY) {
+    wake_writer();
+    sched_yield();
+  }
+
+  records[pos & BINLOG_MASK] = record;
+  atomic_store_explicit(&head, pos + 1, memory_order_release);
+
+  if ((pos + 1) % BINLOG_WAKE_EVERY == 0) {
+    wake_writer();
+  }
+}
+
+/**
+ * Writes out every appended record and closes the log.
+ */
+void close_binlog(void) {
+  if (log_fp == NULL) {
+    return;
+  }
+  atomic_store(&stopping, 1);
+  wake_writer();
+  pthread_join(writer, NULL);
+  fclose(log_fp);
+  log_fp = NULL;
+  free(records);
+}
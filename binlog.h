@@ -0,0 +1,74 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+
+/*
+ * Binary Event Log
+ *
+ * oss appends fixed size records to an in-memory ring and a
+ * background thread writes them out, so logging never waits on
+ * stdio. render_log turns a log back into the text format.
+ *------------------------------------------------------------------*/
+
+#define BINLOG_MAGIC "OSSLOG1"
+
+/**
+ * The result of handling a process action.
+ */
+enum action_outcome {
+  IGNORED,   // Nothing to release, or nothing done
+  GRANTED,   // Instance of the resource claimed
+  RELEASED,  // Instance of the resource released
+  BLOCKED,   // No instances left, waiting for a release
+  REFUSED,   // No instances left for a try request
+  SCHEDULED, // Process put to sleep until a WAKE event
+  TERMINATED // Process released everything and was killed
+};
+
+enum log_type {
+  LOG_REQUEST,         // Detected a request to claim or release
+  LOG_EXCEEDS_CLAIM,   // Request exceeded the maximum claim
+  LOG_GRANT,           // Granted a request to claim
+  LOG_RELEASE,         // Granted a request to release
+  LOG_BLOCK,           // Blocked until the resource is released
+  LOG_REFUSE,          // Turned down a try request
+  LOG_EXPIRE,          // Gave up on a timed request at its deadline
+  LOG_TERMINATE,       // Process is terminating
+  LOG_RELEASED_RES,    // Count of a resource released by a process
+  LOG_BATCH,           // Dispatching a batch of count actions
+  LOG_BATCH_ACTION,    // Outcome of one action in a batch
+  LOG_DEADLOCK,        // Deadlock detection found a deadlock
+  LOG_DEADLOCKED,      // A deadlocked process
+  LOG_RESOLVING,       // Starting to kill deadlocked processes
+  LOG_KILL,            // Killing a deadlocked process
+  LOG_PREEMPT,         // Taking back a deadlocked process's instances
+  LOG_RESOLVED,        // No longer deadlocked
+  LOG_ALLOC_TABLE,     // Start of the resource allocation table
+  LOG_ALLOC_ROW,       // A process in the table
+  LOG_ALLOC_HOLD,      // Count of a resource held in the current row
+  LOG_ALLOC_END        // End of the table
+};
+
+struct binlog_header {
+  char magic[8];
+  uint32_t num_res;      // Columns of the allocation table
+  uint32_t record_size;
+};
+
+struct log_record {
+  uint64_t time;         // Simulated nanoseconds
+  int32_t pid;
+  int32_t res_type;
+  int32_t count;
+  uint8_t type;          // enum log_type
+  uint8_t action;        // enum res_action
+  uint8_t outcome;       // enum action_outcome
+  uint8_t unused;
+};
+
+int open_binlog(const char* path, int num_res);
+void append_log(struct log_record record);
+void close_binlog(void);
+
+#endif
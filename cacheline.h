@@ -0,0 +1,20 @@
+#ifndef CACHELINE_H
+#define CACHELINE_H
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Fields written by one side and polled by the other are kept on
+ * cache lines of their own so unrelated writes don't invalidate them.
+ * Build with -DNO_CACHE_PADDING to pack them back together, which
+ * is only useful to measure what the padding buys.
+ *--------------------------------------------------------------------*/
+#ifdef NO_CACHE_PADDING
+#define CACHE_ALIGNED
+#define NODE_ALIGN_SIZE 8
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#define NODE_ALIGN_SIZE CACHE_LINE_SIZE
+#endif
+
+#endif
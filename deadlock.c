@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "deadlock.h"
+
+static void* alloc_or_die(size_t size) {
+  void* ptr = malloc(size);
+  if (ptr == NULL) {
+    perror("Failed to allocate wait-for graph");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+/**
+ * Initializes a wait-for graph with no blocked processes, emptying
+ * every resource's queue of waiters.
+ *
+ * @param graph The graph
+ * @param res_list The resource list
+ * @param proc_list The process list
+ * @param num_procs Number of process IDs
+ * @param num_res Number of resources
+ */
+void init_wait_graph(struct wait_graph* graph,
+                     struct res_node* res_list,
+                     struct proc_node* proc_list,
+                     int num_procs,
+                     int num_res) {
+  graph->num_procs = num_procs;
+  graph->num_res = num_res;
+  graph->res_list = res_list;
+  graph->proc_list = proc_list;
+  graph->blocked_at = alloc_or_die(sizeof(unsigned long) * num_procs);
+  graph->num_blocked = 0;
+  graph->work = alloc_or_die(sizeof(int) * num_res);
+  graph->queue = alloc_or_die(sizeof(int) * num_procs);
+  graph->reduced = alloc_or_die(num_procs);
+
+  int i = 0;
+  for (; i < num_procs; i++) {
+    struct proc_node* proc = get_proc(proc_list, i);
+    proc->waiting_on = -1;
+    proc->next_waiter = -1;
+    graph->blocked_at[i] = 0;
+  }
+  for (i = 0; i < num_res; i++) {
+    struct res_node* res = get_res(res_list, i);
+    res->first_waiter = -1;
+    res->last_waiter = -1;
+    res->num_waiters = 0;
+  }
+}
+
+void free_wait_graph(struct wait_graph* graph) {
+  free(graph->blocked_at);
+  free(graph->work);
+  free(graph->queue);
+  free(graph->reduced);
+}
+
+/**
+ * Records that a process is blocked waiting on a resource, at the
+ * back of the resource's queue.
+ *
+ * @param graph The graph
+ * @param pid The blocked process
+ * @param res_type The resource it waits on
+ */
+void add_waiter(struct wait_graph* graph, int pid, int res_type) {
+  struct proc_node* proc = get_proc(graph->proc_list, pid);
+  struct res_node* res = get_res(graph->res_list, res_type);
+  proc->waiting_on = res_type;
+  proc->next_waiter = -1;
+  graph->blocked_at[pid] = ++graph->num_blocked;
+
+  if (res->last_waiter == -1) {
+    res->first_waiter = pid;
+  } else {
+    get_proc(graph->proc_list, res->last_waiter)->next_waiter = pid;
+  }
+  res->last_waiter = pid;
+  res->num_waiters++;
+}
+
+/**
+ * Removes a process from the graph, whether it was granted its
+ * request or killed. Does nothing if it wasn't waiting.
+ *
+ * @param graph The graph
+ * @param pid The process
+ */
+void remove_waiter(struct wait_graph* graph, int pid) {
+  struct proc_node* proc = get_proc(graph->proc_list, pid);
+  if (proc->waiting_on == -1) {
+    return;
+  }
+  struct res_node* res = get_res(graph->res_list, proc->waiting_on);
+
+  int prev = -1;
+  int cur = res->first_waiter;
+  while (cur != pid) {
+    prev = cur;
+    cur = get_proc(graph->proc_list, cur)->next_waiter;
+  }
+
+  if (prev == -1) {
+    res->first_waiter = proc->next_waiter;
+  } else {
+    get_proc(graph->proc_list, prev)->next_waiter = proc->next_waiter;
+  }
+  if (res->last_waiter == pid) {
+    res->last_waiter = prev;
+  }
+  res->num_waiters--;
+
+  proc->waiting_on = -1;
+  proc->next_waiter = -1;
+}
+
+/**
+ * Moves a blocked process to the back of another resource's
+ * waiters, keeping when it first blocked.
+ *
+ * @param graph The graph
+ * @param pid The blocked process
+ * @param res_type The resource it now waits on
+ */
+void move_waiter(struct wait_graph* graph, int pid, int res_type) {
+  unsigned long blocked_at = graph->blocked_at[pid];
+  remove_waiter(graph, pid);
+  add_waiter(graph, pid, res_type);
+  graph->blocked_at[pid] = blocked_at;
+  graph->num_blocked--;
+}
+
+int is_waiting(struct wait_graph* graph, int pid) {
+  return get_proc(graph->proc_list, pid)->waiting_on != -1;
+}
+
+/**
+ * @return The longest waiting process on a resource, or -1 if none.
+ */
+int get_first_waiter(struct wait_graph* graph, int res_type) {
+  return get_res(graph->res_list, res_type)->first_waiter;
+}
+
+/**
+ * @return The process waiting behind pid on the same resource, or -1.
+ */
+int get_next_waiter(struct wait_graph* graph, int pid) {
+  return get_proc(graph->proc_list, pid)->next_waiter;
+}
+
+/**
+ * @return The resource a process is blocked on, or -1.
+ */
+int get_waiting_on(struct wait_graph* graph, int pid) {
+  return get_proc(graph->proc_list, pid)->waiting_on;
+}
+
+/**
+ * A process waiting on a single instance can finish once its
+ * resource has a free one. A process waiting on a set needs enough
+ * of every resource in it, shareable ones aside.
+ */
+static int can_reduce(struct wait_graph* graph,
+                      struct res_node* res_list,
+                      struct proc_node* proc,
+                      int res_type) {
+  if (proc->num_requested == 0) {
+    return graph->work[res_type] > 0;
+  }
+  int* counts = get_request_counts(proc);
+  int i = 0;
+  for (; i < graph->num_res; i++) {
+    if (counts[i] > graph->work[i] && !get_res(res_list, i)->shareable) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Marks every process waiting on a resource that can finish.
+ */
+static int reduce_waiters(struct wait_graph* graph,
+                          struct res_node* res_list,
+                          struct proc_node* proc_list,
+                          int res_type,
+                          int tail) {
+  int pid = get_first_waiter(graph, res_type);
+  for (; pid != -1; pid = get_next_waiter(graph, pid)) {
+    if (!graph->reduced[pid] &&
+        can_reduce(graph, res_list, get_proc(proc_list, pid), res_type)) {
+      graph->reduced[pid] = 1;
+      graph->queue[tail++] = pid;
+    }
+  }
+  return tail;
+}
+
+/**
+ * Marks every process waiting on a set it now fits in.
+ */
+static int reduce_set_waiters(struct wait_graph* graph,
+                              struct res_node* res_list,
+                              struct proc_node* proc_list,
+                              int res_type,
+                              int tail) {
+  int pid = get_first_waiter(graph, res_type);
+  for (; pid != -1; pid = get_next_waiter(graph, pid)) {
+    struct proc_node* proc = get_proc(proc_list, pid);
+    if (!graph->reduced[pid] && proc->num_requested > 0 &&
+        can_reduce(graph, res_list, proc, res_type)) {
+      graph->reduced[pid] = 1;
+      graph->queue[tail++] = pid;
+    }
+  }
+  return tail;
+}
+
+static int compare_pids(const void* a, const void* b) {
+  return *(const int*) a - *(const int*) b;
+}
+
+/**
+ * Reduces the wait-for graph. A process that isn't blocked can run
+ * to completion and return what it holds; a process blocked on a
+ * resource with a free instance, or on a set that fits in what's
+ * free, can then do the same. Whoever is left unreduced is
+ * deadlocked. Only blocked processes are visited, so the cost
+ * doesn't grow with the number of processes that are running or
+ * asleep.
+ *
+ * @param graph The graph
+ * @param res_list The resource list
+ * @param proc_list The process list
+ * @param killed A blocked process to reduce as if it had been killed
+ *               and its holds returned, or -1
+ */
+static void reduce_graph(struct wait_graph* graph,
+                         struct res_node* res_list,
+                         struct proc_node* proc_list,
+                         int killed) {
+  struct hold* holds = get_hold_table(res_list);
+  int head = 0;
+  int tail = 0;
+  int num_set_waiters = 0;
+  int i = 0;
+  int pid;
+  int k;
+
+  // Everything not held by a blocked process is free to hand out
+  for (; i < graph->num_res; i++) {
+    graph->work[i] = get_res(res_list, i)->num_instances;
+  }
+  for (i = 0; i < graph->num_res; i++) {
+    for (pid = get_first_waiter(graph, i); pid != -1; pid = get_next_waiter(graph, pid)) {
+      struct proc_node* proc = get_proc(proc_list, pid);
+      graph->reduced[pid] = pid == killed;
+      if (pid == killed) {
+        continue;
+      }
+      num_set_waiters += proc->num_requested > 0;
+      k = proc->last_hold;
+      for (; k != -1; k = holds[k].next) {
+        graph->work[holds[k].res_type]--;
+      }
+    }
+  }
+
+  for (i = 0; i < graph->num_res; i++) {
+    if (graph->work[i] > 0) {
+      tail = reduce_waiters(graph, res_list, proc_list, i, tail);
+    }
+  }
+
+  // Release everything held by blocked processes that can finish.
+  // A set may only fit once several resources are returned, so sets
+  // are checked again whenever that runs dry.
+  do {
+    while (head < tail) {
+      struct proc_node* proc = get_proc(proc_list, graph->queue[head++]);
+      k = proc->last_hold;
+      for (; k != -1; k = holds[k].next) {
+        int res_type = holds[k].res_type;
+        if (graph->work[res_type]++ == 0) {
+          tail = reduce_waiters(graph, res_list, proc_list, res_type, tail);
+        }
+      }
+    }
+    for (i = 0; num_set_waiters > 0 && i < graph->num_res; i++) {
+      tail = reduce_set_waiters(graph, res_list, proc_list, i, tail);
+    }
+  } while (head < tail);
+}
+
+/**
+ * Finds the exact set of deadlocked processes by reducing the
+ * wait-for graph.
+ *
+ * @param graph The graph
+ * @param res_list The resource list
+ * @param proc_list The process list
+ * @param[out] deadlocked IDs of the deadlocked processes, in order
+ * @return The number of deadlocked processes
+ */
+int find_deadlocked(struct wait_graph* graph,
+                    struct res_node* res_list,
+                    struct proc_node* proc_list,
+                    int* deadlocked) {
+  reduce_graph(graph, res_list, proc_list, -1);
+
+  int num_deadlocked = 0;
+  int i = 0;
+  for (; i < graph->num_res; i++) {
+    int pid = get_first_waiter(graph, i);
+    for (; pid != -1; pid = get_next_waiter(graph, pid)) {
+      if (!graph->reduced[pid]) {
+        deadlocked[num_deadlocked++] = pid;
+      }
+    }
+  }
+  qsort(deadlocked, num_deadlocked, sizeof(int), compare_pids);
+  return num_deadlocked;
+}
+
+/**
+ * Counts the processes that would still be deadlocked if a blocked
+ * process were killed. The graph is left unchanged.
+ *
+ * @param graph The graph
+ * @param res_list The resource list
+ * @param proc_list The process list
+ * @param pid The blocked process
+ * @return The number of processes left deadlocked
+ */
+int count_deadlocked_without(struct wait_graph* graph,
+                             struct res_node* res_list,
+                             struct proc_node* proc_list,
+                             int pid) {
+  reduce_graph(graph, res_list, proc_list, pid);
+
+  int num_deadlocked = 0;
+  int i = 0;
+  for (; i < graph->num_res; i++) {
+    int waiter = get_first_waiter(graph, i);
+    for (; waiter != -1; waiter = get_next_waiter(graph, waiter)) {
+      num_deadlocked += !graph->reduced[waiter];
+    }
+  }
+  return num_deadlocked;
+}
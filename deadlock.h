@@ -0,0 +1,49 @@
+#ifndef DEADLOCK_H
+#define DEADLOCK_H
+
+#include <stdatomic.h>
+#include "resource.h"
+
+/*
+ * Wait-for graph between blocked processes and resources.
+ * Holder edges are read from the resource and process lists.
+ * Waiter edges are each resource's FIFO of blocked processes,
+ * linked through the process nodes in shared memory, so a queue
+ * can never hold more than the number of process IDs.
+ * ---------------------------------------------------------------*/
+struct wait_graph {
+  int num_procs;
+  int num_res;
+  struct res_node* res_list;
+  struct proc_node* proc_list;
+  unsigned long* blocked_at;  // When each process blocked, in block order
+  atomic_ulong num_blocked;   // Total blocks so far, across shards
+  // Scratch space for detection
+  int* work;
+  int* queue;
+  char* reduced;
+};
+
+void init_wait_graph(struct wait_graph* graph,
+                     struct res_node* res_list,
+                     struct proc_node* proc_list,
+                     int num_procs,
+                     int num_res);
+void free_wait_graph(struct wait_graph* graph);
+void add_waiter(struct wait_graph* graph, int pid, int res_type);
+void remove_waiter(struct wait_graph* graph, int pid);
+void move_waiter(struct wait_graph* graph, int pid, int res_type);
+int is_waiting(struct wait_graph* graph, int pid);
+int get_first_waiter(struct wait_graph* graph, int res_type);
+int get_next_waiter(struct wait_graph* graph, int pid);
+int get_waiting_on(struct wait_graph* graph, int pid);
+int find_deadlocked(struct wait_graph* graph,
+                    struct res_node* res_list,
+                    struct proc_node* proc_list,
+                    int* deadlocked);
+int count_deadlocked_without(struct wait_graph* graph,
+                             struct res_node* res_list,
+                             struct proc_node* proc_list,
+                             int pid);
+
+#endif
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "event.h"
+
+static void swap_events(struct event* a, struct event* b) {
+  struct event tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/**
+ * Initializes an empty event heap.
+ *
+ * @param heap The heap
+ * @param capacity Initial number of events the heap can hold
+ */
+void init_event_heap(struct event_heap* heap, int capacity) {
+  heap->events = malloc(sizeof(struct event) * capacity);
+  if (heap->events == NULL) {
+    perror("Failed to allocate event heap");
+    exit(EXIT_FAILURE);
+  }
+  heap->size = 0;
+  heap->capacity = capacity;
+}
+
+void free_event_heap(struct event_heap* heap) {
+  free(heap->events);
+  heap->events = NULL;
+  heap->size = 0;
+  heap->capacity = 0;
+}
+
+/**
+ * Adds an event, growing the heap if it's full.
+ *
+ * @param heap The heap
+ * @param ev The event to add
+ */
+void push_event(struct event_heap* heap, struct event ev) {
+  if (heap->size == heap->capacity) {
+    heap->capacity *= 2;
+    heap->events = realloc(heap->events, sizeof(struct event) * heap->capacity);
+    if (heap->events == NULL) {
+      perror("Failed to grow event heap");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  int i = heap->size++;
+  heap->events[i] = ev;
+
+  // Sift up
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (compare_clocks(heap->events[i].time, heap->events[parent].time) >= 0) {
+      break;
+    }
+    swap_events(heap->events + i, heap->events + parent);
+    i = parent;
+  }
+}
+
+/**
+ * Removes the earliest event. The heap must not be empty.
+ *
+ * @param heap The heap
+ * @return The earliest event
+ */
+struct event pop_event(struct event_heap* heap) {
+  struct event top = heap->events[0];
+  heap->events[0] = heap->events[--heap->size];
+
+  // Sift down
+  int i = 0;
+  while (1) {
+    int left = 2 * i + 1;
+    int right = left + 1;
+    int min = i;
+    if (left < heap->size &&
+        compare_clocks(heap->events[left].time, heap->events[min].time) < 0) {
+      min = left;
+    }
+    if (right < heap->size &&
+        compare_clocks(heap->events[right].time, heap->events[min].time) < 0) {
+      min = right;
+    }
+    if (min == i) {
+      break;
+    }
+    swap_events(heap->events + i, heap->events + min);
+    i = min;
+  }
+
+  return top;
+}
+
+/**
+ * @return The earliest event, or NULL if the heap is empty.
+ */
+struct event* peek_event(struct event_heap* heap) {
+  return heap->size > 0 ? heap->events : NULL;
+}
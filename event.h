@@ -0,0 +1,37 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "myclock.h"
+
+enum event_type {
+  FORK,            // Fork a new child process
+  WAKE,            // Wake a child whose deadline has come
+  DETECT_DEADLOCK, // Run the deadlock detection algorithm
+  EXPIRE           // Give up on a timed request whose deadline has come
+};
+
+/*
+ * A timed event in the simulation
+ * -------------------------------*/
+struct event {
+  struct my_clock time;  // When the event fires
+  enum event_type type;
+  int pid;               // Process the event is for, if any
+};
+
+/*
+ * A min-heap of events keyed on time
+ * ----------------------------------*/
+struct event_heap {
+  struct event* events;
+  int size;
+  int capacity;
+};
+
+void init_event_heap(struct event_heap* heap, int capacity);
+void free_event_heap(struct event_heap* heap);
+void push_event(struct event_heap* heap, struct event ev);
+struct event pop_event(struct event_heap* heap);
+struct event* peek_event(struct event_heap* heap);
+
+#endif
@@ -0,0 +1,45 @@
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "futex.h"
+
+/**
+ * Sleeps until woken, as long as the word at addr still equals val.
+ * The futex is not private since the word lives in shared memory
+ * mapped by several processes.
+ *
+ * @param addr Address of the 32-bit word to wait on
+ * @param val The value the caller last saw at addr
+ * @return 0 when woken. -1 on error, including when the word
+ *         already changed (EAGAIN) or a signal arrived (EINTR).
+ */
+int futex_wait(void* addr, int val) {
+  return syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+/**
+ * Like futex_wait(), but gives up after a while.
+ *
+ * @param addr Address of the 32-bit word to wait on
+ * @param val The value the caller last saw at addr
+ * @param nanosecs Longest time to wait, less than a second
+ * @return 0 when woken. -1 on error, including a timeout (ETIMEDOUT).
+ */
+int futex_wait_for(void* addr, int val, long nanosecs) {
+  struct timespec timeout = { 0, nanosecs };
+  return syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0);
+}
+
+/**
+ * Wakes up to num processes waiting on the word at addr.
+ *
+ * @param addr Address of the 32-bit word
+ * @param num Maximum number of waiters to wake. INT_MAX wakes all.
+ * @return The number of waiters woken. -1 on error.
+ */
+int futex_wake(void* addr, int num) {
+  return syscall(SYS_futex, addr, FUTEX_WAKE, num, NULL, NULL, 0);
+}
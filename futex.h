@@ -0,0 +1,12 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+/*
+ * Wait / wake on a 32-bit word in shared memory
+ *----------------------------------------------*/
+
+int futex_wait(void* addr, int val);
+int futex_wait_for(void* addr, int val, long nanosecs);
+int futex_wake(void* addr, int num);
+
+#endif
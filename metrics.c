@@ -0,0 +1,446 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cacheline.h"
+#include "metrics.h"
+#include "myclock.h"
+
+// Where the stats pages are, and when each process's request was sent
+static struct oss_stats* pages;
+static int num_stat_pages;
+static size_t page_size;
+static _Thread_local struct oss_stats* stats;
+static struct oss_stats* totals;  // Summed up when printing
+static uint64_t* requested_at;
+static uint64_t* requested_at_wall;
+static uint64_t start_wall;
+
+/**
+ * Finds the bucket a value falls in. Values below HIST_SUB_BUCKETS
+ * get a bucket each; above that, each power of two gets
+ * HIST_SUB_BUCKETS buckets.
+ */
+static int get_bucket(uint64_t value) {
+  if (value < HIST_SUB_BUCKETS) {
+    return (int) value;
+  }
+  int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+  int sub = (int) (value >> shift) & (HIST_SUB_BUCKETS - 1);
+  return (shift + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+/**
+ * @return The highest value that falls in a bucket
+ */
+static uint64_t get_bucket_max(int bucket) {
+  if (bucket < HIST_SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = bucket / HIST_SUB_BUCKETS - 1;
+  uint64_t sub = bucket % HIST_SUB_BUCKETS;
+  return ((HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/**
+ * Records a value in a histogram.
+ *
+ * @param hist The histogram
+ * @param value The value
+ */
+void record_value(struct histogram* hist, uint64_t value) {
+  if (hist->count == 0 || value < hist->min) {
+    hist->min = value;
+  }
+  if (value > hist->max) {
+    hist->max = value;
+  }
+  hist->count++;
+  hist->sum += value;
+  hist->buckets[get_bucket(value)]++;
+}
+
+/**
+ * Finds the value a percentage of recorded values are at or below,
+ * to the precision of the histogram's buckets.
+ *
+ * @param hist The histogram
+ * @param percentile The percentage, from 0 to 100
+ * @return The value, or 0 if nothing has been recorded
+ */
+uint64_t get_percentile(struct histogram* hist, double percentile) {
+  if (hist->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t) (percentile / 100 * hist->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  int i = 0;
+  for (; i < HIST_NUM_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= rank) {
+      uint64_t value = get_bucket_max(i);
+      return value < hist->max ? value : hist->max;
+    }
+  }
+  return hist->max;
+}
+
+// Pages start on cache lines of their own, since threads write them
+static size_t get_page_size(int num_res) {
+  size_t size = sizeof(struct oss_stats) + sizeof(struct res_stats) * num_res;
+  return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+static struct oss_stats* get_page(int page) {
+  return (struct oss_stats*) ((char*) pages + page * page_size);
+}
+
+/**
+ * @return Size of the stats pages in bytes
+ */
+size_t get_stats_size(int num_res, int num_pages) {
+  return get_page_size(num_res) * num_pages;
+}
+
+/**
+ * Clears the stats pages, binds the calling thread to the first
+ * and starts timing the run.
+ *
+ * @param stats_pages The stats pages in shared memory
+ * @param num_pages One for each thread that records metrics
+ * @param num_res Number of resources
+ * @param num_procs Number of process IDs
+ */
+void init_metrics(struct oss_stats* stats_pages, int num_pages, int num_res, int num_procs) {
+  pages = stats_pages;
+  num_stat_pages = num_pages;
+  page_size = get_page_size(num_res);
+  memset(pages, 0, get_stats_size(num_res, num_pages));
+  int i = 0;
+  for (; i < num_pages; i++) {
+    get_page(i)->num_res = num_res;
+  }
+  bind_metrics(0);
+  totals = malloc(page_size);
+  requested_at = calloc(num_procs, sizeof(uint64_t));
+  requested_at_wall = calloc(num_procs, sizeof(uint64_t));
+  if (totals == NULL || requested_at == NULL || requested_at_wall == NULL) {
+    perror("Failed to allocate metrics");
+    exit(EXIT_FAILURE);
+  }
+  start_wall = read_wall_nanosecs();
+}
+
+/**
+ * Makes the calling thread record its metrics to a page of its own.
+ *
+ * @param page The page
+ */
+void bind_metrics(int page) {
+  stats = get_page(page);
+}
+
+void free_metrics(void) {
+  free(totals);
+  free(requested_at);
+  free(requested_at_wall);
+}
+
+/**
+ * Notes that a process has asked for a resource.
+ *
+ * @param pid The requesting process
+ * @param res_type The requested resource
+ * @param now The simulated time in nanoseconds
+ * @param sent_at The wall time the process sent the request, so
+ *                time spent in the action ring counts toward it
+ */
+void note_request(int pid, int res_type, uint64_t now, uint64_t sent_at) {
+  stats->num_requests++;
+  stats->res[res_type].num_requests++;
+  requested_at[pid] = now;
+  requested_at_wall[pid] = sent_at;
+}
+
+/**
+ * Notes that a process's request was granted, recording how long
+ * it took in simulated and real time.
+ *
+ * @param pid The process
+ * @param now The simulated time in nanoseconds
+ */
+void note_grant(int pid, uint64_t now) {
+  stats->num_grants++;
+  record_value(&stats->sim_latency, now - requested_at[pid]);
+  record_value(&stats->wall_latency, read_wall_nanosecs() - requested_at_wall[pid]);
+}
+
+/**
+ * Notes that a request for a resource had to wait.
+ *
+ * @param res_type The resource
+ * @param num_waiters Length of the resource's queue, counting it
+ */
+void note_block(int res_type, unsigned int num_waiters) {
+  stats->num_blocks++;
+  stats->res[res_type].num_blocks++;
+  if (num_waiters > stats->res[res_type].max_waiters) {
+    stats->res[res_type].max_waiters = num_waiters;
+  }
+}
+
+/**
+ * Notes that a released instance went straight to the process at
+ * the head of the resource's queue.
+ *
+ * @param res_type The resource
+ */
+void note_handoff(int res_type) {
+  stats->num_handoffs++;
+  stats->res[res_type].num_handoffs++;
+}
+
+/**
+ * Notes that a waiter was granted a resource while one queued ahead
+ * of it was left waiting.
+ *
+ * @param res_type The resource
+ */
+void note_bypass(int res_type) {
+  stats->num_bypasses++;
+  stats->res[res_type].num_bypasses++;
+}
+
+void note_release(void) {
+  stats->num_releases++;
+}
+
+void note_termination(void) {
+  stats->num_terminations++;
+}
+
+/**
+ * Notes a run of the deadlock detection algorithm.
+ *
+ * @param num_deadlocked Number of deadlocked processes it found
+ */
+void note_detection(int num_deadlocked) {
+  stats->num_detections++;
+  if (num_deadlocked > 0) {
+    stats->num_deadlocks++;
+  }
+}
+
+/**
+ * Notes that a deadlocked process was killed, and the work thrown
+ * away with it.
+ *
+ * @param num_holds Number of holds it gave up
+ * @param work_lost Simulated nanoseconds it had run, less time blocked
+ */
+void note_kill(int num_holds, uint64_t work_lost) {
+  stats->num_kills++;
+  stats->num_lost_holds += num_holds;
+  record_value(&stats->lost_work, work_lost);
+}
+
+/**
+ * Notes that a deadlocked process was rolled back instead of killed.
+ *
+ * @param num_preempted Number of instances taken back from it
+ */
+void note_preemption(int num_preempted) {
+  stats->num_preemptions++;
+  stats->num_preempted += num_preempted;
+}
+
+void note_refusal(void) {
+  stats->num_refusals++;
+}
+
+void note_expiry(void) {
+  stats->num_expiries++;
+}
+
+static void merge_histogram(struct histogram* into, struct histogram* hist) {
+  if (hist->count == 0) {
+    return;
+  }
+  if (into->count == 0 || hist->min < into->min) {
+    into->min = hist->min;
+  }
+  if (hist->max > into->max) {
+    into->max = hist->max;
+  }
+  into->count += hist->count;
+  into->sum += hist->sum;
+  int i = 0;
+  for (; i < HIST_NUM_BUCKETS; i++) {
+    into->buckets[i] += hist->buckets[i];
+  }
+}
+
+/**
+ * Sums every thread's stats page. Doesn't allocate, since oss
+ * prints its metrics from a signal handler.
+ *
+ * @return The totals
+ */
+static struct oss_stats* sum_pages(void) {
+  struct oss_stats* sum = totals;
+  memset(sum, 0, page_size);
+  sum->num_res = pages->num_res;
+
+  int i = 0;
+  for (; i < num_stat_pages; i++) {
+    struct oss_stats* page = get_page(i);
+    sum->num_requests += page->num_requests;
+    sum->num_grants += page->num_grants;
+    sum->num_releases += page->num_releases;
+    sum->num_blocks += page->num_blocks;
+    sum->num_terminations += page->num_terminations;
+    sum->num_detections += page->num_detections;
+    sum->num_deadlocks += page->num_deadlocks;
+    sum->num_kills += page->num_kills;
+    sum->num_lost_holds += page->num_lost_holds;
+    sum->num_preemptions += page->num_preemptions;
+    sum->num_preempted += page->num_preempted;
+    sum->num_handoffs += page->num_handoffs;
+    sum->num_bypasses += page->num_bypasses;
+    sum->num_refusals += page->num_refusals;
+    sum->num_expiries += page->num_expiries;
+    merge_histogram(&sum->sim_latency, &page->sim_latency);
+    merge_histogram(&sum->wall_latency, &page->wall_latency);
+    merge_histogram(&sum->lost_work, &page->lost_work);
+    int j = 0;
+    for (; j < sum->num_res; j++) {
+      sum->res[j].num_requests += page->res[j].num_requests;
+      sum->res[j].num_blocks += page->res[j].num_blocks;
+      sum->res[j].num_handoffs += page->res[j].num_handoffs;
+      sum->res[j].num_bypasses += page->res[j].num_bypasses;
+      if (page->res[j].max_waiters > sum->res[j].max_waiters) {
+        sum->res[j].max_waiters = page->res[j].max_waiters;
+      }
+    }
+  }
+  return sum;
+}
+
+static void print_histogram(FILE* fp, char* name, struct histogram* hist) {
+  fprintf(fp, "%-24s count=%lu min=%lu p50=%lu p90=%lu p99=%lu p99.9=%lu max=%lu mean=%.0f\n",
+          name,
+          hist->count,
+          hist->count ? hist->min : 0,
+          get_percentile(hist, 50),
+          get_percentile(hist, 90),
+          get_percentile(hist, 99),
+          get_percentile(hist, 99.9),
+          hist->max,
+          hist->count ? (double) hist->sum / hist->count : 0.0);
+}
+
+/**
+ * Prints a summary of the stats page.
+ *
+ * @param fp Where to print it
+ * @param sim_elapsed Simulated nanoseconds the run took
+ */
+void print_metrics(FILE* fp, uint64_t sim_elapsed) {
+  struct oss_stats* stats = sum_pages();
+  double wall_secs = (read_wall_nanosecs() - start_wall) / 1e9;
+  double sim_secs = sim_elapsed / 1e9;
+
+  fprintf(fp, "Metrics\n");
+  fprintf(fp, "Elapsed                  wall=%.3fs simulated=%.3fs\n", wall_secs, sim_secs);
+  fprintf(fp, "Requests                 %lu\n", stats->num_requests);
+  fprintf(fp, "Grants                   %lu (%.0f/s wall, %.2f/s simulated)\n",
+          stats->num_grants,
+          stats->num_grants / wall_secs,
+          sim_secs > 0 ? stats->num_grants / sim_secs : 0.0);
+  fprintf(fp, "Releases                 %lu (%.0f/s wall, %.2f/s simulated)\n",
+          stats->num_releases,
+          stats->num_releases / wall_secs,
+          sim_secs > 0 ? stats->num_releases / sim_secs : 0.0);
+  fprintf(fp, "Blocks                   %lu (%lu handed off, %lu bypassed)\n",
+          stats->num_blocks,
+          stats->num_handoffs,
+          stats->num_bypasses);
+  fprintf(fp, "Backoffs                 %lu refused, %lu expired\n",
+          stats->num_refusals,
+          stats->num_expiries);
+  fprintf(fp, "Terminations             %lu\n", stats->num_terminations);
+  fprintf(fp, "Deadlock detections      %lu (%lu found deadlock)\n",
+          stats->num_detections,
+          stats->num_deadlocks);
+  fprintf(fp, "Deadlock kills           %lu (%lu holds given up)\n",
+          stats->num_kills,
+          stats->num_lost_holds);
+  fprintf(fp, "Deadlock preemptions     %lu (%lu instances taken back)\n",
+          stats->num_preemptions,
+          stats->num_preempted);
+  print_histogram(fp, "Grant latency (sim ns)", &stats->sim_latency);
+  print_histogram(fp, "Grant latency (wall ns)", &stats->wall_latency);
+  print_histogram(fp, "Work lost per kill (ns)", &stats->lost_work);
+
+  fprintf(fp, "Contention\n");
+  int i = 0;
+  for (; i < stats->num_res; i++) {
+    struct res_stats* res = &stats->res[i];
+    fprintf(fp, "  R%02d requests=%lu blocked=%lu (%.1f%%) handoffs=%lu bypasses=%lu max_waiters=%lu\n",
+            i,
+            res->num_requests,
+            res->num_blocks,
+            res->num_requests ? 100.0 * res->num_blocks / res->num_requests : 0.0,
+            res->num_handoffs,
+            res->num_bypasses,
+            res->max_waiters);
+  }
+  fflush(fp);
+}
+
+/**
+ * Prints the headline numbers of the stats page on one line as
+ * key=value pairs, for scripts to collect.
+ *
+ * @param fp Where to print it
+ * @param sim_elapsed Simulated nanoseconds the run took
+ */
+void print_metrics_line(FILE* fp, uint64_t sim_elapsed) {
+  struct oss_stats* stats = sum_pages();
+  double wall_secs = (read_wall_nanosecs() - start_wall) / 1e9;
+
+  fprintf(fp, "wall_s=%.3f sim_s=%.3f requests=%lu grants=%lu grants/sec=%.0f "
+              "releases=%lu releases/sec=%.0f blocks=%lu terminations=%lu "
+              "detections=%lu deadlocks=%lu kills=%lu lost_holds=%lu "
+              "lost_work_s=%.3f lost_work_p50_ns=%lu preemptions=%lu preempted=%lu "
+              "handoffs=%lu bypasses=%lu refusals=%lu expiries=%lu "
+              "sim_p50_ns=%lu sim_p99_ns=%lu wall_p50_ns=%lu wall_p99_ns=%lu\n",
+          wall_secs,
+          sim_elapsed / 1e9,
+          stats->num_requests,
+          stats->num_grants,
+          stats->num_grants / wall_secs,
+          stats->num_releases,
+          stats->num_releases / wall_secs,
+          stats->num_blocks,
+          stats->num_terminations,
+          stats->num_detections,
+          stats->num_deadlocks,
+          stats->num_kills,
+          stats->num_lost_holds,
+          stats->lost_work.sum / 1e9,
+          get_percentile(&stats->lost_work, 50),
+          stats->num_preemptions,
+          stats->num_preempted,
+          stats->num_handoffs,
+          stats->num_bypasses,
+          stats->num_refusals,
+          stats->num_expiries,
+          get_percentile(&stats->sim_latency, 50),
+          get_percentile(&stats->sim_latency, 99),
+          get_percentile(&stats->wall_latency, 50),
+          get_percentile(&stats->wall_latency, 99));
+  fflush(fp);
+}
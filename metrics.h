@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Each power of two is split into 2^HIST_SUB_BITS buckets, so a
+// recorded value is off by at most 1 / 2^HIST_SUB_BITS, about 6%
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_NUM_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/*
+ * A log-linear histogram in the style of HdrHistogram. Fixed size,
+ * so it can live in shared memory, and recording is a few shifts.
+ * -----------------------------------------------------------------*/
+struct histogram {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[HIST_NUM_BUCKETS];
+};
+
+/*
+ * Contention for one resource
+ */
+struct res_stats {
+  uint64_t num_requests;
+  uint64_t num_blocks;
+  uint64_t num_handoffs;  // Releases handed straight to the head waiter
+  uint64_t num_bypasses;  // Grants to a waiter behind one left waiting
+  uint64_t max_waiters;   // Longest the queue of waiters has been
+};
+
+/*
+ * A stats page in shared memory. Each oss thread that grants
+ * requests writes a page of its own; readers sum them. Anything
+ * attached to the arena can read them while the simulation runs.
+ * -------------------------------------------------------------*/
+struct oss_stats {
+  int num_res;
+  uint64_t num_requests;
+  uint64_t num_grants;
+  uint64_t num_releases;
+  uint64_t num_blocks;
+  uint64_t num_terminations;
+  uint64_t num_detections;    // Runs of the deadlock detection algorithm
+  uint64_t num_deadlocks;     // Runs that found a deadlock
+  uint64_t num_kills;         // Processes killed to resolve deadlocks
+  uint64_t num_lost_holds;    // Holds the killed processes gave up
+  uint64_t num_preemptions;   // Processes rolled back to resolve deadlocks
+  uint64_t num_preempted;     // Instances taken back from them
+  uint64_t num_handoffs;      // Releases handed straight to a waiter
+  uint64_t num_bypasses;      // Grants out of FIFO order
+  uint64_t num_refusals;      // Try requests turned down
+  uint64_t num_expiries;      // Timed requests given up at their deadline
+  struct histogram sim_latency;   // Request to grant, simulated nanoseconds
+  struct histogram wall_latency;  // Request to grant, real nanoseconds
+  struct histogram lost_work;     // Per kill, simulated nanoseconds discarded
+  struct res_stats res[];
+};
+
+void record_value(struct histogram* hist, uint64_t value);
+uint64_t get_percentile(struct histogram* hist, double percentile);
+
+size_t get_stats_size(int num_res, int num_pages);
+void init_metrics(struct oss_stats* pages, int num_pages, int num_res, int num_procs);
+void bind_metrics(int page);
+void free_metrics(void);
+void note_request(int pid, int res_type, uint64_t now, uint64_t sent_at);
+void note_grant(int pid, uint64_t now);
+void note_block(int res_type, unsigned int num_waiters);
+void note_handoff(int res_type);
+void note_bypass(int res_type);
+void note_refusal(void);
+void note_expiry(void);
+void note_release(void);
+void note_termination(void);
+void note_detection(int num_deadlocked);
+void note_kill(int num_holds, uint64_t work_lost);
+void note_preemption(int num_preempted);
+void print_metrics(FILE* fp, uint64_t sim_elapsed);
+void print_metrics_line(FILE* fp, uint64_t sim_elapsed);
+
+#endif
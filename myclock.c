@@ -1,13 +1,23 @@
 #include "myclock.h"
 
-struct my_clock add_nanosecs_to_clock(struct my_clock clock, int nanosecs) {
-  struct my_clock new_time;
-  new_time.secs = clock.secs;
-  new_time.nanosecs = clock.nanosecs + nanosecs;
-  if (new_time.nanosecs >= NANOSECS_PER_SEC) {
-    int secs = new_time.nanosecs / NANOSECS_PER_SEC;
-    new_time.secs += secs;
-    new_time.nanosecs -= secs * NANOSECS_PER_SEC;
-  }
-  return new_time;
-}
\ No newline at end of file
+/**
+ * Sets the shared clock. Only oss may call this.
+ *
+ * @param clock The clock in shared memory
+ * @param time The new time
+ */
+void set_shared_clock(struct shared_clock* clock, struct my_clock time) {
+  atomic_store_explicit(&clock->nanosecs,
+                        clock_to_nanosecs(time),
+                        memory_order_release);
+}
+
+/**
+ * Moves the shared clock forward. Only oss may call this.
+ *
+ * @param clock The clock in shared memory
+ * @param nanosecs How far to move it
+ */
+void advance_shared_clock(struct shared_clock* clock, int nanosecs) {
+  atomic_fetch_add_explicit(&clock->nanosecs, nanosecs, memory_order_release);
+}
@@ -1,6 +1,10 @@
 #ifndef MYCLOCK_H
 #define MYCLOCK_H
 
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
 #define NANOSECS_PER_SEC 1000000000  // 1 * 10^9 nanoseconds
 #define NANOSECS_PER_MILLISEC 1000000  // 1 * 10^6
 
@@ -12,6 +16,70 @@ struct my_clock {
   unsigned int nanosecs;    // Amount of time in nanoseconds
 };
 
-struct my_clock add_nanosecs_to_clock(struct my_clock clock, int nanosecs);
+/*
+ * The simulated clock as it lives in shared memory: a single 64-bit
+ * count of nanoseconds. Only oss writes it, so readers load it in one
+ * instruction without locking and can never see a torn time.
+ * ---------------------------------------------------------------------*/
+struct shared_clock {
+  _Atomic uint64_t nanosecs;
+};
+
+void set_shared_clock(struct shared_clock* clock, struct my_clock time);
+void advance_shared_clock(struct shared_clock* clock, int nanosecs);
+
+static inline uint64_t clock_to_nanosecs(struct my_clock clock) {
+  return (uint64_t) clock.secs * NANOSECS_PER_SEC + clock.nanosecs;
+}
+
+static inline struct my_clock nanosecs_to_clock(uint64_t nanosecs) {
+  struct my_clock clock = {
+    (unsigned int) (nanosecs / NANOSECS_PER_SEC),
+    (unsigned int) (nanosecs % NANOSECS_PER_SEC)
+  };
+  return clock;
+}
+
+/**
+ * @return The shared clock's time in nanoseconds.
+ */
+static inline uint64_t read_clock_nanosecs(struct shared_clock* clock) {
+  return atomic_load_explicit(&clock->nanosecs, memory_order_acquire);
+}
+
+/**
+ * @return The shared clock's time.
+ */
+static inline struct my_clock read_clock(struct shared_clock* clock) {
+  return nanosecs_to_clock(read_clock_nanosecs(clock));
+}
+
+/**
+ * @return Non-zero once the shared clock has reached the given time.
+ */
+static inline int is_clock_past(struct shared_clock* clock, uint64_t time) {
+  return read_clock_nanosecs(clock) >= time;
+}
+
+/**
+ * @return Real monotonic time in nanoseconds, comparable across
+ * processes on the same machine.
+ */
+static inline uint64_t read_wall_nanosecs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * NANOSECS_PER_SEC + now.tv_nsec;
+}
+
+/**
+ * Compares two clock times.
+ *
+ * @return Negative if a is before b, zero if equal, positive if after.
+ */
+static inline int compare_clocks(struct my_clock a, struct my_clock b) {
+  uint64_t x = clock_to_nanosecs(a);
+  uint64_t y = clock_to_nanosecs(b);
+  return (x > y) - (x < y);
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -5,6 +5,10 @@
  */
 
 #include <errno.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <limits.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <stdio.h>
@@ -12,10 +16,8 @@
 #include <sys/time.h>
 #include <string.h>
 #include <sys/wait.h>
-#include <sys/ipc.h>
 #include <sys/types.h>
 #include <signal.h>
-#include <sys/shm.h>
 #include <sys/stat.h>
 #include <ctype.h>
 #include <time.h>
@@ -23,55 +25,121 @@
 #include "oss.h"
 #include "ossshm.h"
 #include "myclock.h"
-#include "sem.h"
 #include "resource.h"
+#include "futex.h"
+#include "event.h"
+#include "deadlock.h"
+#include "banker.h"
+#include "pool.h"
+#include "binlog.h"
+#include "trace.h"
+#include "sim.h"
+#include "metrics.h"
+#include "shard.h"
+#include "victim.h"
 
-#define NUM_RES 20
-#define MAX_PROC 18
-#define MAX_PIDS 256
 #define MAX_RUN_TIME 2  // in seconds
 
+// Stands in for the PID of a process with no OS process behind it,
+// one being replayed or simulated in-process
+#define VIRTUAL_PID INT_MAX
+
+extern char** environ;
+
 /*---------*
  | GLOBALS |
  *---------*/
 char* bound = "50";  // in milliseconds
 
-pid_t children[MAX_PIDS];
+// Sizes of the simulation, settable at run time
+static int num_res = 20;
+static int max_instances = 10;
+static int max_procs = 256;
+static int run_time = MAX_RUN_TIME;
+
+pid_t* children;
 
-static FILE* fp;
 
 // Shared Memory Globals
-static int clock_id;
-static struct my_clock* clock_shm;
+static int shm_fd;
+static struct shm_header* shm;
+static int huge_pages = 0;
 
-static int res_list_id;
+static struct shared_clock* clock_shm;
 static struct res_node* res_list;
-
-static int proc_list_id;
+static struct hold* hold_table;
 static struct proc_node* proc_list;
+static struct action_ring* action_ring;
+static struct worker_pool* pool;
+static struct oss_stats* stats = NULL;
 
-static int proc_action_id;
-static struct proc_action* proc_action_shm;
+// How children are launched
+static enum launch_mode launch = LAUNCH_FORK;
+static char user_path[PATH_MAX];
+static int pool_size = 8;
+static pid_t* pool_workers;
+static struct simulation sim;
 
-static int term_pid_id;
-static int* term_pid;
+static int num_procs = 0;
 
-// Semaphore for claiming / releasing resources
-static int sem_id;
+// Children launched and not yet terminated or killed
+static int num_alive = 0;
 
-// Semaphore for communicating a process is terminating
-static int term_sem_id;
+// Cleared once every process ID has been used, since none are reused
+static int is_forking = 1;
 
-static int num_procs = 0;
+// Children not asleep waiting for a WAKE event
+static atomic_int num_running = 0;
+
+static struct event_heap events;
+
+static struct wait_graph wait_graph;
+
+// Milliseconds children holding resources wait for a request, or -1
+// to wait as long as it takes. Each blocked timed request's deadline
+// is kept so a stale EXPIRE event can be told apart.
+static int request_timeout = -1;
+static uint64_t* wait_deadlines;
+
+// Picking which deadlocked process to kill, or to preempt
+static int victim_policy = VICTIM_LIFO;
+static struct victim_selector victims;
+static int preemption = 0;
+
+// Deadlock avoidance with the banker's algorithm
+static int avoidance = 0;
+static struct banker banker;
+
+static int verbose = 0;
+static int metrics_line = 0;
+static int batch = 0;
+static atomic_int num_grants = 0;
+
+// Threads granting requests, each owning a shard of the resources
+static int num_threads = 0;
+static struct shard_pool shards;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int alloc_table_due = 0;
+
+// Set by SIGALRM, SIGINT and SIGPROF. The main loop winds the run down.
+static volatile sig_atomic_t is_stopping = 0;
+
+// Recording and replaying workloads
+static unsigned long seed;
+static struct trace_header* replay = NULL;
+static int num_divergences = 0;
 
 int main(int argc, char* argv[]) {
   int help_flag = 0;
-  int verbose = 0;
+  int k = 0;
   char* log_file = "oss.out";
+  char* trace_file = NULL;
+  char* replay_file = NULL;
+  char bound_str[12];
   opterr = 0;
   int c;
 
-  while ((c = getopt(argc, argv, "hvl:b:")) != -1) {
+  while ((c = getopt(argc, argv, "hvBHMl:b:a:k:D:w:R:I:P:L:W:T:j:s:t:r:")) != -1) {
     switch (c) {
       case 'h':
         help_flag = 1;
@@ -79,12 +147,88 @@ int main(int argc, char* argv[]) {
       case 'v':
         verbose = 1;
         break;
+      case 'B':
+        batch = 1;
+        break;
+      case 'H':
+        huge_pages = 1;
+        break;
+      case 'M':
+        metrics_line = 1;
+        break;
       case 'l':
         log_file = optarg;
         break;
       case 'b':
         bound = optarg;
         break;
+      case 'a':
+        if (strcmp(optarg, "banker") == 0) {
+          avoidance = 1;
+        } else if (strcmp(optarg, "none") != 0) {
+          fprintf(stderr, "Unknown avoidance mode `%s'.\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'k':
+        victim_policy = parse_victim_policy(optarg);
+        if (victim_policy == -1) {
+          fprintf(stderr, "Unknown victim policy `%s'.\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'D':
+        if (strcmp(optarg, "preempt") == 0) {
+          preemption = 1;
+        } else if (strcmp(optarg, "kill") != 0) {
+          fprintf(stderr, "Unknown deadlock resolution `%s'.\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'w':
+        request_timeout = atoi(optarg);
+        break;
+      case 'R':
+        num_res = atoi(optarg);
+        break;
+      case 'I':
+        max_instances = atoi(optarg);
+        break;
+      case 'P':
+        max_procs = atoi(optarg);
+        break;
+      case 'L':
+        if (strcmp(optarg, "fork") == 0) {
+          launch = LAUNCH_FORK;
+        } else if (strcmp(optarg, "spawn") == 0) {
+          launch = LAUNCH_SPAWN;
+        } else if (strcmp(optarg, "pool") == 0) {
+          launch = LAUNCH_POOL;
+        } else if (strcmp(optarg, "sim") == 0) {
+          launch = LAUNCH_SIM;
+        } else {
+          fprintf(stderr, "Unknown launch mode `%s'.\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'W':
+        pool_size = atoi(optarg);
+        break;
+      case 'T':
+        run_time = atoi(optarg);
+        break;
+      case 'j':
+        num_threads = atoi(optarg);
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        trace_file = optarg;
+        break;
+      case 'r':
+        replay_file = optarg;
+        break;
       case '?':
         if (is_required_argument(optopt)) {
           print_required_argument_message(optopt);
@@ -104,173 +248,269 @@ int main(int argc, char* argv[]) {
     exit(EXIT_SUCCESS);
   }
 
-  if (setup_interrupt() == -1) {
-    perror("Failed to set up handler for SIGPROF");
+  if (replay_file != NULL) {
+    replay = map_trace(replay_file);
+    if (replay == NULL) {
+      fprintf(stderr, "Failed to read trace `%s'.\n", replay_file);
+      return EXIT_FAILURE;
+    }
+
+    // Run exactly as the trace was recorded
+    seed = replay->seed;
+    num_res = replay->num_res;
+    max_instances = replay->max_instances;
+    max_procs = replay->max_procs;
+    avoidance = replay->avoidance;
+    batch = replay->batch;
+    victim_policy = replay->victim_policy;
+    preemption = replay->preemption;
+    snprintf(bound_str, sizeof(bound_str), "%d", replay->bound);
+    bound = bound_str;
+    launch = LAUNCH_FORK;
+    trace_file = NULL;
+  } else if (seed == 0) {
+    seed = time(NULL);
+  }
+
+  if (num_res < 1 || max_instances < 1 || max_procs < 1) {
+    fprintf(stderr, "Resource, instance and process counts must be positive.\n");
     return EXIT_FAILURE;
   }
 
-  if (setup_interval_timer(2) == -1) {
-    perror("Faled to set up interval timer");
+  if (run_time < 1) {
+    fprintf(stderr, "The run time must be at least a second.\n");
     return EXIT_FAILURE;
   }
 
-  srand(time(NULL));
+  if (request_timeout < -1) {
+    fprintf(stderr, "The request timeout can't be negative.\n");
+    return EXIT_FAILURE;
+  }
 
-  signal(SIGINT, free_shm_and_abort);
-  signal(SIGALRM, free_shm_and_abort);
+  if (num_threads < 0) {
+    fprintf(stderr, "The number of threads can't be negative.\n");
+    return EXIT_FAILURE;
+  }
 
-  int num_grants = 0;
+  // Each of these needs every resource at once
+  if (num_threads > 0 &&
+      (avoidance || batch || preemption || trace_file != NULL || replay != NULL)) {
+    fprintf(stderr, "Threads can't be combined with -a banker, -B, -D preempt, -t or -r.\n");
+    return EXIT_FAILURE;
+  }
 
-  fp = fopen(log_file, "w+");
+  if (pool_size < 1) {
+    fprintf(stderr, "The worker pool must have at least one worker.\n");
+    return EXIT_FAILURE;
+  }
 
-  if (fp == NULL) {
-    perror("Failed to open log file");
-    exit(EXIT_FAILURE);
+  if (launch != LAUNCH_POOL) {
+    pool_size = 0;
   }
 
-  clock_id = get_clock_shm();
-  clock_shm = attach_to_clock_shm(clock_id);
+  if (replay == NULL && launch != LAUNCH_SIM && find_user_path() == -1) {
+    fprintf(stderr, "Failed to find the user executable.\n");
+    return EXIT_FAILURE;
+  }
 
-  res_list_id = get_res_list(NUM_RES);
-  res_list = attach_to_res_list(res_list_id);
-  init_res_list(res_list);
+  if (setup_interrupt() == -1) {
+    perror("Failed to set up handler for SIGPROF");
+    return EXIT_FAILURE;
+  }
 
-  proc_list_id = get_proc_list(MAX_PIDS);
-  proc_list = attach_to_proc_list(proc_list_id);
-  init_proc_list(proc_list);
+  // A replay runs to the end of the trace
+  if (replay == NULL && setup_interval_timer(run_time) == -1) {
+    perror("Faled to set up interval timer");
+    return EXIT_FAILURE;
+  }
+
+  srand(seed);
+
+  signal(SIGINT, stop_run);
+  signal(SIGALRM, stop_run);
+
+  if (open_binlog(log_file, num_res) == -1) {
+    perror("Failed to open log file");
+    exit(EXIT_FAILURE);
+  }
 
-  proc_action_id = get_proc_action();
-  proc_action_shm = attach_to_proc_action(proc_action_id);
-  init_proc_action(proc_action_shm);
+  if (trace_file != NULL) {
+    struct trace_header trace = {
+      .seed = seed,
+      .num_res = num_res,
+      .max_instances = max_instances,
+      .max_procs = max_procs,
+      .bound = atoi(bound),
+      .avoidance = avoidance,
+      .batch = batch,
+      .victim_policy = victim_policy,
+      .preemption = preemption
+    };
+    if (open_trace(trace_file, &trace) == -1) {
+      perror("Failed to open trace file");
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  term_pid_id = get_int_shm();
-  term_pid = attach_to_int_shm(term_pid_id);
+  init_layout(num_res, max_instances, max_procs);
 
-  // Initialize to a value not equal to a PID
-  reset_term_pid(term_pid);
+  // Assign 1 to max_instances instances per resource
+  int* num_instances = malloc(sizeof(int) * num_res);
+  int total_instances = 0;
+  for (k = 0; k < num_res; k++) {
+    num_instances[k] = rand() % max_instances + 1;
+    total_instances += num_instances[k];
+  }
 
-  sem_id = allocate_sem(IPC_PRIVATE, IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
-  init_sem(sem_id, 1);
+  struct shm_header header = {
+    .num_res = num_res,
+    .max_instances = max_instances,
+    .max_procs = max_procs,
+    .bound = atoi(bound),
+    .avoidance = avoidance,
+    .pool_size = pool_size,
+    .num_threads = num_threads,
+    .request_timeout = request_timeout,
+    .seed = seed
+  };
+  plan_shm_arena(&header, total_instances);
+  shm = create_shm_arena(&header, huge_pages, &shm_fd);
+
+  clock_shm = get_shm_clock(shm);
+  res_list = get_shm_res_list(shm);
+  hold_table = get_hold_table(res_list);
+  proc_list = get_shm_proc_list(shm);
+  action_ring = get_shm_action_ring(shm);
+  pool = get_shm_worker_pool(shm);
+  stats = get_shm_stats(shm);
+
+  init_res_list(res_list, num_instances);
+
+  if (avoidance) {
+    init_banker(&banker, max_procs, num_res, num_instances);
+  }
+  free(num_instances);
 
-  term_sem_id = allocate_sem(IPC_PRIVATE, IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
-  init_sem(term_sem_id, 1);
+  init_proc_list(proc_list);
+  init_action_ring(action_ring);
+  init_worker_pool(pool, pool_size);
+  init_metrics(stats, num_threads + 1, num_res, max_procs);
+
+  if (launch == LAUNCH_SIM) {
+    init_simulation(&sim, max_procs);
+    sim.clock = clock_shm;
+    sim.res_list = res_list;
+    sim.proc_list = proc_list;
+    sim.ring = action_ring;
+    sim.num_res = num_res;
+    sim.bound = atoi(bound);
+    sim.avoidance = avoidance;
+    sim.request_sets = num_threads == 0;  // A set can span shards
+    sim.request_timeout = request_timeout;
+  }
 
   // Initialize clock to 1 second to simulate overhead
-  clock_shm->secs = 1;
+  set_shared_clock(clock_shm, (struct my_clock) { 1, 0 });
 
   // Initialize children PIDs to -10
-  int k = 0;
-  for (; k < MAX_PIDS; k++)
+  children = malloc(sizeof(pid_t) * max_procs);
+  for (k = 0; k < max_procs; k++)
     children[k] = -10;
 
-  fork_and_exec_child(0);
+  init_event_heap(&events, max_procs);
+  init_wait_graph(&wait_graph, res_list, proc_list, max_procs, num_res);
+  init_victim_selector(&victims, victim_policy, max_procs);
+  wait_deadlines = calloc(max_procs, sizeof(uint64_t));
 
-  struct my_clock fork_time = get_time_to_fork();
-  // struct my_clock dd_time = get_time_to_detect_deadlock(atoi(bound));
+  pool_workers = malloc(sizeof(pid_t) * pool_size);
+  fill_worker_pool();
 
-  while (1) {
-    increment_clock();
-
-    if (is_past_time(fork_time)) {
-      int pid = get_next_available_pid();
-      if (pid != -10 && num_procs < MAX_PIDS) {
-        fork_and_exec_child(pid);
-        fork_time = get_time_to_fork();
-      }
-    }
+  if (num_threads > 0) {
+    start_shards(&shards, num_threads, handle_action, action_ring);
+  }
 
-    // if (is_past_time(dd_time)) {
-    //   detect_deadlock();
-    //   dd_time = get_time_to_detect_deadlock(atoi(bound));
-    // }
-
-    // Check for resource requests and releases
-    if (is_proc_action_available(proc_action_shm)) {
-      struct proc_node* proc = proc_list + proc_action_shm->pid;
-      struct res_node* res = res_list + proc_action_shm->res_type;
-      enum res_action action = proc_action_shm->action;
-      char* action_str = action == REQUEST ? "claim" : "release";
-
-      proc->request = res->type;
-
-      if (verbose) {
-        fprintf(fp,
-                "[%02d:%010d] Detected P%02d request to %s R%02d\n",
-                clock_shm->secs,
-                clock_shm->nanosecs,
-                proc->id,
-                action_str,
-                res->type);
-      }
+  launch_child(0);
+  schedule_fork();
+  schedule_deadlock_detection();
 
+  if (replay != NULL) {
+    replay_trace();
+    print_run_metrics();
+    close_binlog();
+    free_shm();
+    return EXIT_SUCCESS;
+  }
 
-      increment_clock();
+  while (!is_stopping) {
+    // Simulated processes run until they next wait on us
+    if (launch == LAUNCH_SIM) {
+      run_sim_procs(&sim);
+    }
 
-      // Grant requests to claim or release resources
-      if (action == REQUEST && can_grant_request(res->type)) {
-        if (verbose) {
-          fprintf(fp,
-                    "[%02d:%010d] Granting P%02d request for R%02d\n",
-                    clock_shm->secs,
-                    clock_shm->nanosecs,
-                    proc->id,
-                    res->type);
-        }
-        num_grants++;
-        int i = get_res_instance(res);
-        proc->request = -1;
-        res->num_allocated++;
-        res->held_by[i] = proc->id;
-        proc->holds[i] = res->type;
-        if (num_grants % 20 == 0 && num_grants != 0 && verbose) {
-          print_res_alloc_table();
-        }
-      } else if (action == RELEASE && has_resource(proc->id)) {
-        if (verbose) {
-          fprintf(fp,
-                  "[%02d:%010d] Granting P%02d request to release R%02d\n",
-                  clock_shm->secs,
-                  clock_shm->nanosecs,
-                  proc->id,
-                  res->type);
-        }
-        
-        int i = 0;
-        while (proc->holds[i] != -1) {
-          i++;
+    // Drain all pending resource requests and releases
+    if (batch) {
+      struct proc_action actions[ACTION_RING_SIZE];
+      int num_actions = 0;
+      while (num_actions < ACTION_RING_SIZE &&
+             dequeue_action(action_ring, actions + num_actions) == 0) {
+        num_actions++;
+      }
+      if (num_actions > 0) {
+        record_batch(actions, num_actions);
+        handle_action_batch(actions, num_actions);
+        continue;
+      }
+    } else {
+      struct proc_action action;
+      int num_actions = 0;
+      while (dequeue_action(action_ring, &action) == 0) {
+        record_action(action);
+        if (num_threads > 0) {
+          dispatch_action(action);
+        } else {
+          handle_action(action);
         }
-        res->num_allocated--;
-        res->held_by[--i] = -1;
-        proc->holds[i] = -1;
-      } else if ((res->num_instances - res->num_allocated) == 0) {
-        detect_deadlock(res->type, proc->id);
+        num_actions++;
       }
+      if (num_actions > 0) {
+        continue;
+      }
+    }
 
-      increment_clock();
+    // Some children are still running, or threads still granting,
+    // so time can't move on until they're done. Sleep until one of
+    // them calls. Simulated processes have all run by now.
+    if ((num_running > 0 && launch != LAUNCH_SIM) ||
+        (num_threads > 0 && !are_shards_idle(&shards))) {
+      wait_for_action(action_ring);
+      continue;
+    }
 
-      // Reset process action
-      init_proc_action(proc_action_shm);
+    if (atomic_exchange(&alloc_table_due, 0)) {
+      print_res_alloc_table();
     }
 
-    // Check for terminating processes
-    if (*term_pid != -10) {
-      // Release all resources held by process
-      int released_res[NUM_RES];
-      release_res(*term_pid, released_res, NUM_RES);
-      if (verbose) {
-        fprintf(fp,
-                "[%02d:%010d] Detected P%02d is terminating\n",
-                clock_shm->secs,
-                clock_shm->nanosecs,
-                *term_pid);
-        print_released_res(released_res, NUM_RES);
-      }
-      kill_child(*term_pid);
-      reset_term_pid(term_pid);  // Set back to -10
+    // Every child is gone and none are left to fork
+    if (peek_event(&events) == NULL) {
+      break;
     }
+
+    // Everyone is asleep. Jump straight to the next event.
+    struct event ev = pop_event(&events);
+    record_event(ev);
+    handle_event(ev);
+  }
+
+  // A signal can end the run while threads are still granting
+  if (num_threads > 0) {
+    wait_for_shards(&shards);
   }
 
+  print_run_metrics();
+  close_trace();
+  close_binlog();
   free_shm();
+  kill_children();
 
   return EXIT_SUCCESS;
 }
@@ -279,42 +519,47 @@ int main(int argc, char* argv[]) {
  * Frees all allocated shared memory
  */
 static void free_shm(void) {
-  detach_from_clock_shm(clock_shm);
-  shmctl(clock_id, IPC_RMID, 0);
-
-  detach_from_res_list(res_list);
-  shmctl(res_list_id, IPC_RMID, 0);
-
-  detach_from_proc_list(proc_list);
-  shmctl(proc_list_id, IPC_RMID, 0);
-
-  detach_from_proc_action(proc_action_shm);
-  shmctl(proc_action_id, IPC_RMID, 0);
-
-  detach_from_int_shm(term_pid);
-  shmctl(term_pid_id, IPC_RMID, 0);
-
-  deallocate_sem(sem_id);
-
-  deallocate_sem(term_sem_id);
+  // The arena is anonymous, so it's gone once every process lets go
+  detach_from_shm_arena(shm);
+  close(shm_fd);
 }
 
 /**
- * Free shared memory and abort program
+ * Asks the main loop to end the run, waking it if it's asleep on
+ * the action ring. Only does what's safe in a signal handler.
  */
-static void free_shm_and_abort(int s) {
-  free_shm();
-  kill_children();
-  abort();
+static void stop_run(int s) {
+  is_stopping = 1;
+  if (action_ring != NULL) {
+    atomic_fetch_add(&action_ring->doorbell, 1);
+    futex_wake(&action_ring->doorbell, 1);
+  }
 }
 
 
+/**
+ * Prints the run's metrics, if the simulation got far enough
+ * to have any.
+ */
+static void print_run_metrics(void) {
+  if (stats == NULL) {
+    return;
+  }
+  // The clock starts at 1 second
+  uint64_t sim_elapsed = read_clock_nanosecs(clock_shm) - NANOSECS_PER_SEC;
+  if (metrics_line) {
+    print_metrics_line(stdout, sim_elapsed);
+  } else {
+    print_metrics(stdout, sim_elapsed);
+  }
+}
+
 /**
  * Set up the interrupt handler.
  */
 static int setup_interrupt(void) {
   struct sigaction act;
-  act.sa_handler = free_shm_and_abort;
+  act.sa_handler = stop_run;
   act.sa_flags = 0;
   return (sigemptyset(&act.sa_mask) || sigaction(SIGPROF, &act, NULL));
 }
@@ -349,9 +594,33 @@ static void print_help_message(char* executable_name,
   printf("Arguments:\n");
   printf(" -h  Show help.\n");
   printf(" -v  Specify verbose log output.\n");
+  printf(" -B  Dispatch all pending requests and releases as one batch.\n");
+  printf(" -H  Back shared memory with huge pages when available.\n");
+  printf(" -M  Print metrics at exit on one line of key=value pairs.\n");
   printf(" -l  Specify the log file. Defaults to '%s'.\n", log_file);
   printf(" -b  Specify the upper bound for when processes should request or release a resource.\n");
   printf("     Defaults to %s milliseconds.\n", bound);
+  printf(" -a  Specify the deadlock avoidance mode, 'none' or 'banker'.\n");
+  printf("     Defaults to 'none'.\n");
+  printf(" -k  Specify how deadlock victims are picked: 'lifo' (most recently blocked),\n");
+  printf("     'holds' (fewest held), 'youngest', 'work' (least work lost) or 'minset'\n");
+  printf("     (fewest left deadlocked). Defaults to 'lifo'.\n");
+  printf(" -D  Specify how deadlocks are resolved, 'kill' or 'preempt'. Preempting takes\n");
+  printf("     back the victim's instances and rolls it back. Defaults to 'kill'.\n");
+  printf(" -w  Specify how many milliseconds children holding resources wait for a request\n");
+  printf("     before backing off, 0 to only try. Defaults to waiting as long as it takes.\n");
+  printf(" -R  Specify the number of resources. Defaults to %d.\n", num_res);
+  printf(" -I  Specify the most instances a resource can have. Defaults to %d.\n", max_instances);
+  printf(" -P  Specify the number of process IDs. Defaults to %d.\n", max_procs);
+  printf(" -L  Specify how children are launched, 'fork', 'spawn', 'pool' or 'sim'.\n");
+  printf("     Defaults to 'fork'.\n");
+  printf(" -W  Specify the number of pre-spawned workers with -L pool. Defaults to %d.\n", pool_size);
+  printf(" -T  Specify how long to run in seconds. Defaults to %d.\n", run_time);
+  printf(" -j  Specify the number of threads granting requests, each owning a shard of\n");
+  printf("     the resources. Defaults to 0, granting on oss's main thread.\n");
+  printf(" -s  Specify the random seed. Defaults to the current time.\n");
+  printf(" -t  Record the workload to a trace file.\n");
+  printf(" -r  Replay a recorded trace file without forking children.\n");
 }
 
 /**
@@ -366,6 +635,34 @@ static int is_required_argument(char optopt) {
       return 1;
     case 'b':
       return 1;
+    case 'a':
+      return 1;
+    case 'k':
+      return 1;
+    case 'D':
+      return 1;
+    case 'w':
+      return 1;
+    case 'R':
+      return 1;
+    case 'I':
+      return 1;
+    case 'P':
+      return 1;
+    case 'L':
+      return 1;
+    case 'W':
+      return 1;
+    case 'T':
+      return 1;
+    case 'j':
+      return 1;
+    case 's':
+      return 1;
+    case 't':
+      return 1;
+    case 'r':
+      return 1;
     default:
       return 0;
   }
@@ -388,122 +685,247 @@ static void print_required_argument_message(char option) {
               "Option -%c requires the name of the log file.\n",
               optopt);
       break;
+    case 'a':
+      fprintf(stderr,
+              "Option -%c requires the deadlock avoidance mode.\n",
+              optopt);
+      break;
+    case 'k':
+      fprintf(stderr,
+              "Option -%c requires the victim policy.\n",
+              optopt);
+      break;
+    case 'D':
+      fprintf(stderr,
+              "Option -%c requires the deadlock resolution.\n",
+              optopt);
+      break;
+    case 'w':
+      fprintf(stderr,
+              "Option -%c requires the request timeout in milliseconds.\n",
+              optopt);
+      break;
+    case 'R':
+      fprintf(stderr,
+              "Option -%c requires the number of resources.\n",
+              optopt);
+      break;
+    case 'I':
+      fprintf(stderr,
+              "Option -%c requires the most instances a resource can have.\n",
+              optopt);
+      break;
+    case 'P':
+      fprintf(stderr,
+              "Option -%c requires the number of process IDs.\n",
+              optopt);
+      break;
+    case 'L':
+      fprintf(stderr,
+              "Option -%c requires the launch mode.\n",
+              optopt);
+      break;
+    case 'W':
+      fprintf(stderr,
+              "Option -%c requires the number of pooled workers.\n",
+              optopt);
+      break;
+    case 'T':
+      fprintf(stderr,
+              "Option -%c requires the run time in seconds.\n",
+              optopt);
+      break;
+    case 'j':
+      fprintf(stderr,
+              "Option -%c requires the number of threads.\n",
+              optopt);
+      break;
+    case 's':
+      fprintf(stderr,
+              "Option -%c requires the random seed.\n",
+              optopt);
+      break;
+    case 't':
+      fprintf(stderr,
+              "Option -%c requires the name of the trace file to record.\n",
+              optopt);
+      break;
+    case 'r':
+      fprintf(stderr,
+              "Option -%c requires the name of the trace file to replay.\n",
+              optopt);
+      break;
+  }
+}
+
+
+/**
+ * Finds the user executable once, so launching a child never has
+ * to search for it. Looks on the PATH first, like execlp() would,
+ * then next to oss itself. The path is made absolute, so it doesn't
+ * depend on the working directory a child starts in.
+ *
+ * @return 0 on success. -1 if user can't be found.
+ */
+static int find_user_path(void) {
+  char found[PATH_MAX];
+  int is_found = 0;
+  char* path = getenv("PATH");
+  if (path != NULL) {
+    char* dirs = strdup(path);
+    char* dir = strtok(dirs, ":");
+    for (; dir != NULL && !is_found; dir = strtok(NULL, ":")) {
+      snprintf(found, sizeof(found), "%s/user", *dir ? dir : ".");
+      is_found = access(found, X_OK) == 0;
+    }
+    free(dirs);
+  }
+
+  if (!is_found) {
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len == -1) {
+      return -1;
+    }
+    exe[len] = '\0';
+    snprintf(found, sizeof(found), "%s/user", dirname(exe));
+    if (access(found, X_OK) == -1) {
+      return -1;
+    }
+  }
+
+  return realpath(found, user_path) == NULL ? -1 : 0;
+}
+
+/**
+ * Starts a user process.
+ *
+ * @param pid The simulated process ID, or -1 for a pooled worker
+ * @param slot The worker's pool slot, or -1 if not pooled
+ * @return The child's PID
+ */
+static pid_t start_user(int pid, int slot) {
+  char pid_str[12];
+  snprintf(pid_str,
+           sizeof(pid_str),
+           "%d",
+           pid);
+
+  char shm_fd_str[12];
+  snprintf(shm_fd_str,
+           sizeof(shm_fd_str),
+           "%d",
+           shm_fd);
+
+  char slot_str[12];
+  snprintf(slot_str,
+           sizeof(slot_str),
+           "%d",
+           slot);
+
+  char* args[] = {
+    "user",
+    pid_str,
+    shm_fd_str,
+    slot == -1 ? NULL : slot_str,
+    NULL
+  };
+
+  pid_t child;
+  if (launch == LAUNCH_FORK) {
+    child = fork();
+    if (child == -1) {
+      perror("Failed to fork");
+      exit(EXIT_FAILURE);
+    }
+    if (child == 0) {  // Child
+      execv(user_path, args);
+      perror("Failed to exec");
+      _exit(EXIT_FAILURE);
+    }
+  } else {
+    // posix_spawn() uses vfork, so there's no page table to copy
+    int error = posix_spawn(&child, user_path, NULL, NULL, args, environ);
+    if (error != 0) {
+      fprintf(stderr, "Failed to spawn: %s\n", strerror(error));
+      exit(EXIT_FAILURE);
+    }
   }
+  return child;
 }
 
+/**
+ * Starts a worker for every empty pool slot.
+ */
+static void fill_worker_pool(void) {
+  int i = 0;
+  for (; i < pool->num_slots; i++) {
+    if (atomic_load(&pool->slots[i].state) == SLOT_EMPTY) {
+      atomic_store(&pool->slots[i].state, SLOT_STARTING);
+      pool_workers[i] = start_user(-1, i);
+    }
+  }
+}
 
 /**
- * Forks and execs a child process.
+ * Launches a child process, handing the pid to a parked
+ * worker when one is ready. Simulated processes are started
+ * in-process.
  * 
  * @param index Index of children PID array
  */
-static void fork_and_exec_child(int index) {
+static void launch_child(int index) {
   num_procs++;
-  children[index] = fork();
+  num_alive++;
+  num_running++;
+  note_proc_started(&victims, index, read_clock_nanosecs(clock_shm));
+
+  // Replayed processes exist only in the trace
+  if (replay != NULL) {
+    children[index] = VIRTUAL_PID;
+    return;
+  }
 
-  if (children[index] == -1) {
-    perror("Failed to fork");
-    exit(EXIT_FAILURE);
+  if (launch == LAUNCH_SIM) {
+    children[index] = VIRTUAL_PID;
+    start_sim_proc(&sim, index, seed + index);
+    return;
   }
 
-  if (children[index] == 0) {  // Child
-    char pid_str[12];
-    snprintf(pid_str,
-             sizeof(pid_str),
-             "%d",
-             index);
-
-    char num_res_str[12];
-    snprintf(num_res_str,
-             sizeof(num_res_str),
-             "%d",
-             NUM_RES);
-
-    char clock_id_str[12];
-    snprintf(clock_id_str,
-             sizeof(clock_id_str),
-             "%d",
-             clock_id);
-
-    char res_list_id_str[12];
-    snprintf(res_list_id_str,
-             sizeof(res_list_id_str),
-             "%d",
-             res_list_id);
-
-    char proc_list_id_str[12];
-    snprintf(proc_list_id_str,
-             sizeof(proc_list_id_str),
-             "%d",
-             proc_list_id);
-
-    char proc_action_id_str[12];
-    snprintf(proc_action_id_str,
-             sizeof(proc_action_id_str),
-             "%d",
-             proc_action_id);
-
-    char term_pid_id_str[12];
-    snprintf(term_pid_id_str,
-             sizeof(term_pid_id_str),
-             "%d",
-             term_pid_id);
-
-    char sem_id_str[12];
-    snprintf(sem_id_str,
-             sizeof(sem_id_str),
-             "%d",
-             sem_id);
-
-    char term_sem_id_str[12];
-    snprintf(term_sem_id_str,
-             sizeof(term_sem_id_str),
-             "%d",
-             term_sem_id);
-
-    execlp("user",
-           "user",
-           pid_str,
-           bound,
-           num_res_str,
-           clock_id_str,
-           res_list_id_str,
-           proc_list_id_str,
-           proc_action_id_str,
-           term_pid_id_str,
-           sem_id_str,
-           term_sem_id_str,
-           (char*) NULL);
-    perror("Failed to exec");
-    _exit(EXIT_FAILURE);
+  if (launch == LAUNCH_POOL) {
+    int slot = find_parked_worker(pool);
+    if (slot != -1) {
+      children[index] = pool_workers[slot];
+      pool_workers[slot] = -1;
+      assign_worker(pool, slot, index);
+      return;
+    }
   }
+
+  children[index] = start_user(index, -1);
 }
 
 /**
  * Initializes the resource list with:
- *   - 1 to 10 instances per resource
+ *   - The given number of instances per resource
  *   - First 3 to 5 resources are shareable
  */
-static void init_res_list(struct res_node* res_list) {
+static void init_res_list(struct res_node* res_list, int* num_instances) {
   int num_shareable = (rand() % 3) + 3;  // 3 to 5
+  unsigned int first_instance = 0;
   int i = 0;
-  for (; i < NUM_RES; i++) {
-    // Assign 1 to 10 instances per resource
-    (res_list + i)->num_instances = rand() % MAX_INSTANCES + 1;
-
-    (res_list + i)->num_allocated = 0;
+  for (; i < num_res; i++) {
+    struct res_node* res = get_res(res_list, i);
+    res->type = i;
+    res->num_instances = num_instances[i];
 
-    (res_list + i)->type = i;
+    init_res_instances(res, first_instance, hold_table);
+    first_instance += res->num_instances;
 
     // Assign first 3 to 5 resources as shareable
     int is_shareable = num_shareable > 0 ? 1 : 0;
-    (res_list + i)->shareable = is_shareable;
+    res->shareable = is_shareable;
     num_shareable--;
-
-    int j = 0;
-    for (; j < MAX_INSTANCES; j++) {
-      (res_list + i)->held_by[j] = -1;
-    }
   }
 }
 
@@ -514,19 +936,25 @@ static void init_res_list(struct res_node* res_list) {
  */
 static void init_proc_list(struct proc_node* proc_list) {
   int i = 0;
-  for (; i < MAX_PIDS; i++) {
-    proc_list[i].id = i;
-    proc_list[i].request = -1;
-    int j = 0;
-    for (; j < MAX_HOLDS; j++) {
-      proc_list[i].holds[j] = -1;
-    }
+  for (; i < max_procs; i++) {
+    struct proc_node* proc = get_proc(proc_list, i);
+    proc->id = i;
+    proc->request = -1;
+    proc->num_requested = 0;
+    proc->preempted = 0;
+    proc->refused = 0;
+    proc->num_holds = 0;
+    proc->last_hold = -1;
+    atomic_init(&proc->wake_seq, 0);
+    memset(get_max_claim(proc), 0, sizeof(int) * num_res);
+    memset(get_request_counts(proc), 0, sizeof(int) * num_res);
+    memset(get_hold_counts(proc), 0, sizeof(unsigned short) * num_res);
   }
 }
 
 // static void print_res_list(struct res_node* res_list) {
 //   int i = 0;
-//   for (; i < NUM_RES; i++) {
+//   for (; i < num_res; i++) {
 //     print_res_node(*(res_list + i));
 //   }
 // }
@@ -546,122 +974,924 @@ static void init_proc_list(struct proc_node* proc_list) {
 //   printf("\n");
 // }
 
+/**
+ * @return Nonzero if the action asks for an instance of a resource.
+ */
+static int is_request(enum res_action action) {
+  return action == REQUEST || action == TRY_REQUEST || action == REQUEST_UNTIL;
+}
+
 /**
  * Kills all remaining children
  */
 static void kill_children() {
   int i = 0;
-  for (; i < MAX_PIDS; i++)
-    if (children[i] != -10) {
-      kill(children[i], SIGKILL);
+  for (; i < max_procs; i++)
+    if (children[i] > 0) {
+      if (children[i] != VIRTUAL_PID)
+        kill(children[i], SIGKILL);
       num_procs--;
     }
+
+  for (i = 0; i < pool_size; i++)
+    if (pool_workers[i] > 0)
+      kill(pool_workers[i], SIGKILL);
 }
 
 static int can_grant_request(int request) {
-  struct res_node* res = (res_list + request);
+  struct res_node* res = get_res(res_list, request);
   return res->num_instances - res->num_allocated;
 }
 
-static void init_proc_action(struct proc_action* pa) {
-  pa->pid = -10;
-  pa->res_type = -10;
-  pa->action = IDLE;
-}
-
-static int is_proc_action_available(struct proc_action* pa) {
-  return pa->pid != -10 && pa->res_type != -10 && pa->action != IDLE;
-}
-
-static int has_resource(int pid) {
-  return (proc_list + pid)->holds[0] != -1 ? 1 : 0;
-}
-
 /**
- * Print resource allocation table
+ * Handles a request for a set of instances, granting all of them
+ * or none. A set that can't be granted whole blocks on a resource
+ * it's short of, and the process holds on to nothing extra meanwhile.
+ *
+ * @param action The action dequeued from the action ring
  */
-static void print_res_alloc_table(void) {
-  // Print header row
-  fprintf(fp, "\n    ");
-  int i = 0;
-  for (; i < NUM_RES; i++)
-    fprintf(fp, "R%02d ", i);
-  fprintf(fp, "\n");
-
-  i = 0;
-  for (; i < ((NUM_RES + 1) * 4); i++)
-    fprintf(fp, "-");
-  fprintf(fp, "\n");
-
-  // Print how many resources each process holds
-  i = 0;
-  for(; i < MAX_PIDS; i++) {
-    if (children[i] != -10 && children[i] != -20) {
-      fprintf(fp, "P%02d  ", i);
-      int j = 0;
-      for (; j < NUM_RES; j++) {
-        int amt = 0;
-        int k = 0;
-        for (; k < MAX_INSTANCES; k++) {
-          if ((res_list + j)->held_by[k] == i)
-            amt++;
-        }
-        fprintf(fp, "%02d  ", amt);
-      }
-      fprintf(fp, "\n");
+static void handle_request_set(struct proc_action action) {
+  struct proc_node* proc = get_proc(proc_list, action.pid);
+
+  if (verbose) {
+    log_action(LOG_REQUEST, action, IGNORED);
+  }
+  note_request(proc->id, action.res_type, read_clock_nanosecs(clock_shm), action.sent_at);
+  increment_clock();
+
+  int excess_res = find_excess_res(proc);
+  if (excess_res != -1) {
+    log_event(LOG_EXCEEDS_CLAIM, proc->id, excess_res, 0);
+    terminate_proc(proc->id);
+    return;
+  }
+
+  if (is_set_grantable(proc)) {
+    grant_res_set(proc);
+    if (++num_grants % 20 == 0 && verbose) {
+      show_res_alloc_table();
+    }
+  } else {
+    struct res_node* res = get_res(res_list, get_set_block_res(proc));
+    if (verbose) {
+      log_event(LOG_BLOCK, proc->id, res->type, 0);
     }
+    block_proc(proc, res);
   }
-  fprintf(fp, "\n");
-}
 
+  increment_clock();
+}
 
 /**
- * Resets the value of the terminating PID to -10
+ * Handles a request to claim or release a shareable resource.
+ * Shared holds are only counted, so a request is granted on the
+ * spot without checking claims or safety, and a release never has
+ * waiters to retry.
  *
- * @param[in] Pointer to terminating PID
+ * @param action The action dequeued from the action ring
+ * @param proc The acting process
+ * @param res The shareable resource
  */
-static void reset_term_pid(int* term_pid) {
-  *term_pid = -10;
+static void handle_shared_action(struct proc_action action,
+                                 struct proc_node* proc,
+                                 struct res_node* res) {
+  if (verbose) {
+    log_action(LOG_REQUEST, action, IGNORED);
+  }
+  increment_clock();
+
+  if (is_request(action.action)) {
+    note_request(proc->id, res->type, read_clock_nanosecs(clock_shm), action.sent_at);
+    if (verbose) {
+      log_event(LOG_GRANT, proc->id, res->type, 0);
+    }
+    grant_res(proc, res);
+    if (++num_grants % 20 == 0 && verbose) {
+      show_res_alloc_table();
+    }
+  } else if (get_hold_counts(proc)[res->type] > 0) {
+    if (verbose) {
+      log_event(LOG_RELEASE, proc->id, res->type, 0);
+    }
+    release_last_res(proc, res);
+  }
 }
 
 /**
- * Releases all resources for a given PID.
+ * Handles a request to claim or release a resource.
  *
- * @param pid The ID of the process
+ * @param action The action dequeued from the action ring
  */
-static void release_res(int pid,
-                        int* released_res,
-                        int num_res) {
-  int i = 0;
-  for (; i < num_res; i++) {
-    released_res[i] = 0;
-    int j = 0;
-    for (; j < MAX_INSTANCES; j++) {
-      struct res_node* res = res_list + i;
-      if (res->held_by[j] == pid) {
-        res->held_by[j] = -1;
-        released_res[i]++;
-        res->num_allocated--;
-      }
-      increment_clock();
-    }
-    increment_clock();
+static void handle_action(struct proc_action action) {
+  if (action.action == SLEEP) {
+    schedule_wake(action.pid, action.time);
+    return;
+  } else if (action.action == TERMINATE) {
+    terminate_proc(action.pid);
+    return;
+  } else if (action.action == CLAIM) {
+    declare_claim(&banker, action.pid, get_max_claim(get_proc(proc_list, action.pid)));
+    return;
+  } else if (action.action == REQUEST_SET) {
+    handle_request_set(action);
+    return;
+  } else if (action.action == RELEASE && !resolve_release(&action)) {
+    return;  // Nothing to release
   }
-  struct proc_node* proc = proc_list + pid;
-  int k = 0;
-  while (proc->holds[k] != -1 && k < MAX_INSTANCES) {
-    proc->holds[k] = -1;
-    k++;
-    increment_clock();
+
+  struct proc_node* proc = get_proc(proc_list, action.pid);
+  struct res_node* res = get_res(res_list, action.res_type);
+
+  if (res->shareable) {
+    handle_shared_action(action, proc, res);
+    return;
   }
-}
 
-static int is_past_time(struct my_clock myclock) {
-  return (clock_shm->secs     >= myclock.secs &&
-          clock_shm->nanosecs >= myclock.nanosecs);
-}
+  if (verbose) {
+    log_action(LOG_REQUEST, action, IGNORED);
+  }
 
-/**
+  if (is_request(action.action)) {
+    note_request(proc->id, res->type, read_clock_nanosecs(clock_shm), action.sent_at);
+  }
+
+  increment_clock();
+
+  if (is_request(action.action) && avoidance &&
+      exceeds_claim(&banker, proc->id, res->type)) {
+    log_event(LOG_EXCEEDS_CLAIM, proc->id, res->type, 0);
+    terminate_proc(proc->id);
+    return;
+  }
+
+  // Grant requests to claim or release resources
+  if (is_request(action.action) && is_grantable(proc, res)) {
+    if (verbose) {
+      log_event(LOG_GRANT, proc->id, res->type, 0);
+    }
+    grant_res(proc, res);
+    if (++num_grants % 20 == 0 && verbose) {
+      show_res_alloc_table();
+    }
+  } else if (action.action == RELEASE) {
+    if (verbose) {
+      log_event(LOG_RELEASE, proc->id, res->type, 0);
+    }
+    release_last_res(proc, res);
+    retry_waiters(res);
+  } else if (action.action == TRY_REQUEST) {
+    if (verbose) {
+      log_event(LOG_REFUSE, proc->id, res->type, 0);
+    }
+    refuse_request(proc);
+  } else if (is_request(action.action)) {
+    if (verbose) {
+      log_event(LOG_BLOCK, proc->id, res->type, 0);
+    }
+    block_proc(proc, res);
+    if (action.action == REQUEST_UNTIL) {
+      set_wait_deadline(proc, action.time);
+    }
+  }
+
+  increment_clock();
+}
+
+/**
+ * Hands a request or release to the thread owning its resource.
+ * Sleeps only touch the event heap, so they're handled right away.
+ * Anything else can touch every shard, so it waits until the
+ * threads are idle.
+ *
+ * @param action The action dequeued from the action ring
+ */
+static void dispatch_action(struct proc_action action) {
+  if (action.action == IDLE) {
+    return;  // The threads went idle
+  }
+  if (action.action == REQUEST_UNTIL) {
+    schedule_expiry(action.pid, action.time);
+  }
+  if (action.action == RELEASE && !resolve_release(&action)) {
+    return;  // Nothing to release
+  }
+  if (is_request(action.action) || action.action == RELEASE) {
+    dispatch_to_shard(&shards, action);
+    return;
+  }
+  if (action.action != SLEEP) {
+    wait_for_shards(&shards);
+  }
+  handle_action(action);
+}
+
+/**
+ * Handles a batch of requests and releases in one pass.
+ * Releases are applied first so requests in the same batch can
+ * claim the freed instances. The batch is logged as one record set.
+ *
+ * @param actions The actions dequeued from the action ring
+ * @param num_actions Number of actions in the batch
+ */
+static void handle_action_batch(struct proc_action* actions, int num_actions) {
+  enum action_outcome outcomes[ACTION_RING_SIZE];
+  int prev_num_grants = num_grants;
+  int i = 0;
+
+  increment_clock();
+
+  for (i = 0; i < num_actions; i++) {
+    outcomes[i] = IGNORED;
+    if (actions[i].action == RELEASE && !resolve_release(&actions[i])) {
+      continue;  // Nothing to release
+    }
+    struct proc_node* proc = get_proc(proc_list, actions[i].pid);
+    struct res_node* res = get_res(res_list, actions[i].res_type);
+    if (actions[i].action == RELEASE) {
+      release_last_res(proc, res);
+      retry_waiters(res);
+      outcomes[i] = RELEASED;
+    } else if (actions[i].action == SLEEP) {
+      schedule_wake(actions[i].pid, actions[i].time);
+      outcomes[i] = SCHEDULED;
+    } else if (actions[i].action == TERMINATE) {
+      terminate_proc(actions[i].pid);
+      outcomes[i] = TERMINATED;
+    } else if (actions[i].action == CLAIM) {
+      declare_claim(&banker, actions[i].pid, get_max_claim(proc));
+      outcomes[i] = SCHEDULED;
+    }
+  }
+
+  for (i = 0; i < num_actions; i++) {
+    struct proc_node* proc = get_proc(proc_list, actions[i].pid);
+    struct res_node* res = get_res(res_list, actions[i].res_type);
+    if (actions[i].action == REQUEST_SET) {
+      note_request(proc->id, res->type, read_clock_nanosecs(clock_shm), actions[i].sent_at);
+      if (find_excess_res(proc) != -1) {
+        terminate_proc(proc->id);
+        outcomes[i] = TERMINATED;
+      } else if (is_set_grantable(proc)) {
+        grant_res_set(proc);
+        num_grants++;
+        outcomes[i] = GRANTED;
+      } else {
+        block_proc(proc, get_res(res_list, get_set_block_res(proc)));
+        outcomes[i] = BLOCKED;
+      }
+      continue;
+    }
+    if (!is_request(actions[i].action)) {
+      continue;
+    }
+    note_request(proc->id, res->type, read_clock_nanosecs(clock_shm), actions[i].sent_at);
+    // Shared holds aren't claimed, as in handle_shared_action()
+    if (!res->shareable && avoidance && exceeds_claim(&banker, proc->id, res->type)) {
+      terminate_proc(proc->id);
+      outcomes[i] = TERMINATED;
+    } else if (is_grantable(proc, res)) {
+      grant_res(proc, res);
+      num_grants++;
+      outcomes[i] = GRANTED;
+    } else if (actions[i].action == TRY_REQUEST) {
+      refuse_request(proc);
+      outcomes[i] = REFUSED;
+    } else {
+      block_proc(proc, res);
+      if (actions[i].action == REQUEST_UNTIL) {
+        set_wait_deadline(proc, actions[i].time);
+      }
+      outcomes[i] = BLOCKED;
+    }
+  }
+
+  increment_clock();
+
+  if (verbose) {
+    print_action_batch(actions, outcomes, num_actions);
+    if (num_grants / 20 != prev_num_grants / 20) {
+      print_res_alloc_table();
+    }
+  }
+}
+
+/**
+ * Logs the outcome of every action in a batch.
+ *
+ * @param actions The actions in the batch
+ * @param outcomes The outcome of each action
+ * @param num_actions Number of actions in the batch
+ */
+static void print_action_batch(struct proc_action* actions,
+                               enum action_outcome* outcomes,
+                               int num_actions) {
+  log_event(LOG_BATCH, -1, -1, num_actions);
+  int i = 0;
+  for (; i < num_actions; i++) {
+    if (outcomes[i] != SCHEDULED) {
+      log_action(LOG_BATCH_ACTION, actions[i], outcomes[i]);
+    }
+  }
+}
+
+/**
+ * Logs an event at the current simulated time.
+ *
+ * @param type What happened
+ * @param pid The process it happened to, or -1
+ * @param res_type The resource it happened to, or -1
+ * @param count A count, for the events that have one
+ */
+static void log_event(enum log_type type, int pid, int res_type, int count) {
+  struct log_record record = {
+    .time = read_clock_nanosecs(clock_shm),
+    .pid = pid,
+    .res_type = res_type,
+    .count = count,
+    .type = type
+  };
+  write_log_record(record);
+}
+
+/**
+ * Logs a process action and its outcome at the current simulated time.
+ *
+ * @param type What happened
+ * @param action The action
+ * @param outcome The outcome of the action
+ */
+static void log_action(enum log_type type,
+                       struct proc_action action,
+                       enum action_outcome outcome) {
+  struct log_record record = {
+    .time = read_clock_nanosecs(clock_shm),
+    .pid = action.pid,
+    .res_type = action.res_type,
+    .type = type,
+    .action = action.action,
+    .outcome = outcome
+  };
+  write_log_record(record);
+}
+
+/**
+ * Appends a record to the log. The log takes one writer at a time,
+ * so shard threads take turns.
+ *
+ * @param record The record
+ */
+static void write_log_record(struct log_record record) {
+  if (num_threads > 0) {
+    pthread_mutex_lock(&log_lock);
+    append_log(record);
+    pthread_mutex_unlock(&log_lock);
+  } else {
+    append_log(record);
+  }
+}
+
+/**
+ * Allocates an instance of a resource, or a shared hold on a
+ * shareable one, to a process.
+ * Clearing the process's request signals the grant to the child.
+ *
+ * @param proc The requesting process
+ * @param res The requested resource
+ */
+static void grant_res(struct proc_node* proc, struct res_node* res) {
+  if (res->shareable) {
+    add_shared_hold(proc, res);
+  } else {
+    add_hold(proc, res, hold_table);
+    if (avoidance) {
+      banker_grant(&banker, proc->id, res->type);
+    }
+  }
+  proc->request = -1;
+  note_grant(proc->id, read_clock_nanosecs(clock_shm));
+  wake_proc(proc);
+}
+
+/**
+ * Releases the most recently claimed resource of a process, or one
+ * of its shared holds when the resource is shareable. An instance
+ * someone is queued for is handed straight to the head waiter.
+ * Dropping the process's hold count signals the release to the child.
+ *
+ * @param proc The releasing process
+ * @param res The resource being released
+ */
+static void release_last_res(struct proc_node* proc, struct res_node* res) {
+  int waiter = -1;
+  if (res->shareable) {
+    drop_shared_hold(proc, res);
+  } else if (can_hand_off(res)) {
+    waiter = res->first_waiter;
+    hand_off_last_hold(proc, get_proc(proc_list, waiter), res, hold_table);
+  } else {
+    drop_last_hold(proc, res, hold_table);
+    if (avoidance) {
+      banker_release(&banker, proc->id, res->type);
+    }
+  }
+  note_release();
+  wake_proc(proc);
+  if (waiter != -1) {
+    grant_handed_off(get_proc(proc_list, waiter), res);
+  }
+}
+
+/**
+ * A released instance goes straight to the head of the resource's
+ * queue when that waiter wants just the one instance. A set waiter
+ * needs the others checked too, and in avoidance mode the head may
+ * not be safe to grant, so those go through grant_waiters() instead.
+ *
+ * @param res The resource being released
+ * @return Nonzero if the instance can be handed off.
+ */
+static int can_hand_off(struct res_node* res) {
+  return !avoidance && res->first_waiter != -1 &&
+         get_proc(proc_list, res->first_waiter)->num_requested == 0;
+}
+
+/**
+ * Grants the request a process at the head of a resource's queue
+ * blocked on, once a release has handed it the instance, and wakes
+ * it without the instance ever having been free.
+ *
+ * @param proc The process the instance was handed to
+ * @param res The resource
+ */
+static void grant_handed_off(struct proc_node* proc, struct res_node* res) {
+  remove_waiter(&wait_graph, proc->id);
+  note_proc_unblocked(&victims, proc->id, read_clock_nanosecs(clock_shm));
+  if (verbose && !batch) {
+    log_event(LOG_GRANT, proc->id, res->type, 0);
+  }
+  num_grants++;
+  num_running++;
+  proc->request = -1;
+  note_handoff(res->type);
+  note_grant(proc->id, read_clock_nanosecs(clock_shm));
+  wake_proc(proc);
+}
+
+/**
+ * Blocks a process until an instance of a resource is released.
+ *
+ * @param proc The requesting process
+ * @param res The exhausted resource
+ */
+static void block_proc(struct proc_node* proc, struct res_node* res) {
+  add_waiter(&wait_graph, proc->id, res->type);
+  wait_deadlines[proc->id] = 0;
+  note_proc_blocked(&victims, proc->id, read_clock_nanosecs(clock_shm));
+  note_block(res->type, res->num_waiters);
+  num_running--;
+}
+
+/**
+ * Gives a blocked request a deadline, past which oss gives up on it.
+ * Shard threads can't touch the event heap, so with threads the main
+ * thread schedules the EXPIRE event as it dispatches the request.
+ *
+ * @param proc The blocked process
+ * @param deadline When to give up
+ */
+static void set_wait_deadline(struct proc_node* proc, struct my_clock deadline) {
+  wait_deadlines[proc->id] = clock_to_nanosecs(deadline);
+  if (num_threads == 0) {
+    schedule_expiry(proc->id, deadline);
+  }
+}
+
+/**
+ * Turns down a request and wakes the process, which backs off.
+ *
+ * @param proc The requesting process
+ */
+static void refuse_request(struct proc_node* proc) {
+  proc->refused = 1;
+  proc->request = -1;
+  note_refusal();
+  wake_proc(proc);
+}
+
+/**
+ * Gives up on a timed request whose deadline has come, taking the
+ * process off its resource's queue. Does nothing if the request was
+ * granted in time, or the process is waiting on another request.
+ *
+ * @param pid The process
+ * @param deadline The request's deadline
+ */
+static void expire_request(int pid, struct my_clock deadline) {
+  if (!is_waiting(&wait_graph, pid) ||
+      wait_deadlines[pid] != clock_to_nanosecs(deadline)) {
+    return;
+  }
+  if (verbose) {
+    log_event(LOG_EXPIRE, pid, get_waiting_on(&wait_graph, pid), 0);
+  }
+  remove_waiter(&wait_graph, pid);
+  note_proc_unblocked(&victims, pid, read_clock_nanosecs(clock_shm));
+  note_expiry();
+  num_running++;
+
+  struct proc_node* proc = get_proc(proc_list, pid);
+  proc->refused = 1;
+  proc->request = -1;
+  wake_proc(proc);
+}
+
+/**
+ * Determines whether a request can be granted right now.
+ * In avoidance mode the grant must also leave the system safe.
+ *
+ * @param proc The requesting process
+ * @param res The requested resource
+ * @return Nonzero if the request can be granted.
+ */
+static int is_grantable(struct proc_node* proc, struct res_node* res) {
+  if (res->shareable) {
+    return 1;
+  }
+  if (!can_grant_request(res->type)) {
+    return 0;
+  }
+  return !avoidance || is_safe_to_grant(&banker, proc->id, res->type);
+}
+
+/**
+ * Finds a resource a set request asks for more of than it could
+ * ever be granted: more than the process's claim allows in
+ * avoidance mode, or more instances than there are.
+ *
+ * @param proc The requesting process
+ * @return The resource, or -1 if the set can be granted some day
+ */
+static int find_excess_res(struct proc_node* proc) {
+  int* counts = get_request_counts(proc);
+  int i = 0;
+  for (; i < num_res; i++) {
+    struct res_node* res = get_res(res_list, i);
+    if (counts[i] == 0) {
+      continue;
+    }
+    if (avoidance && counts[i] > get_remaining_claim(&banker, proc->id, i)) {
+      return i;
+    }
+    if (!res->shareable && counts[i] > (int) res->num_instances) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Finds a resource a set request needs more free instances of.
+ *
+ * @param proc The requesting process
+ * @return The resource, or -1 if there are enough of everything
+ */
+static int find_short_res(struct proc_node* proc) {
+  int* counts = get_request_counts(proc);
+  int i = 0;
+  for (; i < num_res; i++) {
+    if (counts[i] > 0 && !get_res(res_list, i)->shareable &&
+        counts[i] > can_grant_request(i)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Determines whether a whole set request can be granted right now.
+ * In avoidance mode the grant must also leave the system safe; the
+ * banker's algorithm leaves shareable resources out.
+ *
+ * @param proc The requesting process
+ * @return Nonzero if the set can be granted.
+ */
+static int is_set_grantable(struct proc_node* proc) {
+  if (find_short_res(proc) != -1) {
+    return 0;
+  }
+  if (!avoidance) {
+    return 1;
+  }
+  int* counts = get_request_counts(proc);
+  int exclusive_counts[num_res];
+  int i = 0;
+  for (; i < num_res; i++) {
+    exclusive_counts[i] = get_res(res_list, i)->shareable ? 0 : counts[i];
+  }
+  return is_safe_to_grant_set(&banker, proc->id, exclusive_counts);
+}
+
+/**
+ * Gets the resource a set request that can't be granted waits on:
+ * one it's short of, or, when the grant would be unsafe, the first
+ * exclusive resource in the set.
+ *
+ * @param proc The requesting process
+ * @return The resource
+ */
+static int get_set_block_res(struct proc_node* proc) {
+  int res_type = find_short_res(proc);
+  if (res_type != -1) {
+    return res_type;
+  }
+  int* counts = get_request_counts(proc);
+  int i = 0;
+  for (; i < num_res; i++) {
+    if (counts[i] > 0 && !get_res(res_list, i)->shareable) {
+      return i;
+    }
+  }
+  return proc->request;
+}
+
+/**
+ * Allocates every instance in a set request to a process at once.
+ * Clearing the process's request signals the grant to the child.
+ *
+ * @param proc The requesting process
+ */
+static void grant_res_set(struct proc_node* proc) {
+  int* counts = get_request_counts(proc);
+  int i = 0;
+  for (; i < num_res; i++) {
+    struct res_node* res = get_res(res_list, i);
+    if (counts[i] > 0 && verbose && !batch) {
+      log_event(LOG_GRANT, proc->id, i, counts[i]);
+    }
+    for (; counts[i] > 0; counts[i]--) {
+      if (res->shareable) {
+        add_shared_hold(proc, res);
+      } else {
+        add_hold(proc, res, hold_table);
+        if (avoidance) {
+          banker_grant(&banker, proc->id, i);
+        }
+      }
+    }
+  }
+  proc->num_requested = 0;
+  proc->request = -1;
+  note_grant(proc->id, read_clock_nanosecs(clock_shm));
+  wake_proc(proc);
+}
+
+/**
+ * Retries a blocked set request after instances of the resource it
+ * waits on were freed. If it's still short of another resource, it
+ * waits on that one instead.
+ *
+ * @param proc The blocked process
+ * @param res The resource with freed instances
+ * @return Nonzero if the set was granted.
+ */
+static int retry_request_set(struct proc_node* proc, struct res_node* res) {
+  if (is_set_grantable(proc)) {
+    remove_waiter(&wait_graph, proc->id);
+    note_proc_unblocked(&victims, proc->id, read_clock_nanosecs(clock_shm));
+    num_grants++;
+    num_running++;
+    grant_res_set(proc);
+    return 1;
+  }
+  int res_type = find_short_res(proc);
+  if (res_type != -1 && res_type != (int) res->type) {
+    move_waiter(&wait_graph, proc->id, res_type);
+  }
+  return 0;
+}
+
+/**
+ * Grants freed instances of a resource to its waiters in FIFO order.
+ * In avoidance mode, waiters whose grant would be unsafe are skipped,
+ * as are sets that don't fit yet; granting anyone behind them is
+ * counted as a bypass.
+ *
+ * @param res The resource with freed instances
+ */
+static void grant_waiters(struct res_node* res) {
+  int pid = get_first_waiter(&wait_graph, res->type);
+  int skipped = 0;
+  while (pid != -1 && can_grant_request(res->type)) {
+    int next = get_next_waiter(&wait_graph, pid);
+    struct proc_node* proc = get_proc(proc_list, pid);
+    int granted;
+    if (proc->num_requested > 0) {
+      granted = retry_request_set(proc, res);
+    } else if ((granted = is_grantable(proc, res))) {
+      remove_waiter(&wait_graph, pid);
+      note_proc_unblocked(&victims, pid, read_clock_nanosecs(clock_shm));
+      if (verbose && !batch) {
+        log_event(LOG_GRANT, pid, res->type, 0);
+      }
+      num_grants++;
+      num_running++;
+      grant_res(proc, res);
+    }
+    if (granted && skipped) {
+      note_bypass(res->type);
+    }
+    skipped |= !granted;
+    pid = next;
+  }
+}
+
+/**
+ * Retries blocked requests after a release. In avoidance mode a
+ * release can make waiters on any resource safe, so all are retried.
+ *
+ * @param res The released resource
+ */
+static void retry_waiters(struct res_node* res) {
+  if (res->shareable) {
+    return;  // Nothing waits on a shareable resource
+  }
+  if (!avoidance) {
+    grant_waiters(res);
+    return;
+  }
+  int i = 0;
+  for (; i < num_res; i++) {
+    grant_waiters(get_res(res_list, i));
+  }
+}
+
+/**
+ * Wakes a process blocked waiting for oss to act on it.
+ *
+ * @param proc The process to wake
+ */
+static void wake_proc(struct proc_node* proc) {
+  atomic_fetch_add(&proc->wake_seq, 1);
+  if (launch == LAUNCH_SIM) {
+    wake_sim_proc(&sim, proc->id);
+  } else if (replay == NULL) {
+    futex_wake(&proc->wake_seq, 1);
+  }
+}
+
+/**
+ * Works out what a release gives back from the process's own holds
+ * rather than trusting the resource the child named: its most
+ * recent hold, or else one of its shared holds.
+ *
+ * @param action The release, whose resource is set in place
+ * @return 0 if the process holds nothing to release
+ */
+static int resolve_release(struct proc_action* action) {
+  int res_type = get_release_res(get_proc(proc_list, action->pid), res_list);
+  if (res_type == -1) {
+    return 0;
+  }
+  action->res_type = res_type;
+  return 1;
+}
+
+/**
+ * Logs the resource allocation table. With shard threads, the main
+ * thread logs it once they're idle, so the table is consistent.
+ */
+static void show_res_alloc_table(void) {
+  if (num_threads > 0) {
+    atomic_store(&alloc_table_due, 1);
+  } else {
+    print_res_alloc_table();
+  }
+}
+
+/**
+ * Log resource allocation table
+ */
+static void print_res_alloc_table(void) {
+  log_event(LOG_ALLOC_TABLE, -1, -1, 0);
+
+  // Log how many resources each process holds
+  int i = 0;
+  for(; i < max_procs; i++) {
+    if (children[i] != -10 && children[i] != -20) {
+      log_event(LOG_ALLOC_ROW, i, -1, 0);
+      unsigned short* hold_counts = get_hold_counts(get_proc(proc_list, i));
+      int j = 0;
+      for (; j < num_res; j++) {
+        if (hold_counts[j] != 0) {
+          log_event(LOG_ALLOC_HOLD, i, j, hold_counts[j]);
+        }
+      }
+    }
+  }
+  log_event(LOG_ALLOC_END, -1, -1, 0);
+}
+
+
+/**
+ * Releases all resources held by a terminating process and kills it.
+ *
+ * @param pid The ID of the terminating process
+ */
+static void terminate_proc(int pid) {
+  int released_res[num_res];
+  release_res(pid, released_res, num_res);
+  if (verbose && !batch) {
+    log_event(LOG_TERMINATE, pid, -1, 0);
+    print_released_res(released_res, num_res);
+  }
+  note_termination();
+  num_running--;
+  kill_child(pid);
+}
+
+/**
+ * Schedules a sleeping process to be woken at a given time.
+ *
+ * @param pid The ID of the sleeping process
+ * @param time When to wake the process
+ */
+static void schedule_wake(int pid, struct my_clock time) {
+  struct event ev = { time, WAKE, pid };
+  push_event(&events, ev);
+  num_running--;
+}
+
+/**
+ * Schedules giving up on a timed request at its deadline.
+ */
+static void schedule_expiry(int pid, struct my_clock deadline) {
+  struct event ev = { deadline, EXPIRE, pid };
+  push_event(&events, ev);
+}
+
+/**
+ * Schedules the next run of the deadlock detection algorithm.
+ */
+static void schedule_deadlock_detection(void) {
+  struct event ev = { get_time_to_detect_deadlock(atoi(bound)), DETECT_DEADLOCK, -1 };
+  push_event(&events, ev);
+}
+
+/**
+ * Schedules the next fork, 1 to 250 milliseconds into the future.
+ */
+static void schedule_fork(void) {
+  struct event ev = { get_time_to_fork(), FORK, -1 };
+  push_event(&events, ev);
+}
+
+/**
+ * Releases all resources for a given PID.
+ * Only the process's own holds are visited.
+ *
+ * @param pid The ID of the process
+ */
+static void release_res(int pid,
+                        int* released_res,
+                        int num_res) {
+  struct proc_node* proc = get_proc(proc_list, pid);
+  int num_released = drop_all_holds(proc, res_list, released_res);
+  proc->num_requested = 0;
+  proc->preempted = 0;
+  proc->refused = 0;
+  memset(get_request_counts(proc), 0, sizeof(int) * num_res);
+  advance_shared_clock(clock_shm, 50 * num_released);
+
+  if (avoidance) {
+    banker_release_all(&banker, pid);
+  }
+
+  int i = 0;
+  for (; i < num_res; i++) {
+    // Nothing waits on a shareable resource, so retrying one
+    // wouldn't retry the other resources' waiters in avoidance mode
+    if (released_res[i] > 0 && !get_res(res_list, i)->shareable) {
+      retry_waiters(get_res(res_list, i));
+      if (avoidance) {
+        break;  // Every waiter was retried
+      }
+    }
+  }
+}
+
+/**
+ * Moves the clock forward to a given time.
+ * The clock never moves backward.
+ *
+ * @param time The time to move to
+ */
+static void set_clock(struct my_clock time) {
+  if (clock_to_nanosecs(time) > read_clock_nanosecs(clock_shm)) {
+    set_shared_clock(clock_shm, time);
+  }
+}
+
+/**
  * Get a random amount of milliseconds
  *
  * @param bound Maximum bound in millisecons
@@ -676,24 +1906,30 @@ int get_rand_millisecs(int bound) {
  * 1 to 250 milliseconds into the future.
  */
 struct my_clock get_time_to_fork() {
-  struct my_clock fork_time;
-  fork_time.secs     = clock_shm->secs;
-  fork_time.nanosecs = clock_shm->nanosecs;
   int time_to_fork = get_rand_millisecs(250);
-  fork_time = add_nanosecs_to_clock(fork_time, time_to_fork);
-  return fork_time;
+  return nanosecs_to_clock(read_clock_nanosecs(clock_shm) + time_to_fork);
 }
 
+/**
+ * Finds the lowest pid never launched. Pids aren't reused, so the
+ * search picks up where the last one stopped, but the clock still
+ * pays for every pid a search from 0 would have looked at.
+ *
+ * @return The pid, or -10 when every pid has been used
+ */
 static int get_next_available_pid() {
-  int i = 0;
-  while (children[i++] != -10)
-    increment_clock();
-  
-  if (i == MAX_PIDS) {
+  static int next_pid = 0;
+  while (next_pid < max_procs && children[next_pid] != -10) {
+    next_pid++;
+  }
+
+  advance_shared_clock(clock_shm, 50 * next_pid);
+
+  if (next_pid == max_procs) {
     return -10;
   }
-  
-  return --i;
+
+  return next_pid;
 }
 
 /**
@@ -703,70 +1939,392 @@ static int get_next_available_pid() {
  * @return Time to run deadlock detection algorithm
  */
 struct my_clock get_time_to_detect_deadlock(int bound) {
-  struct my_clock dd_time;
-  dd_time.secs     = clock_shm->secs;
-  dd_time.nanosecs = clock_shm->nanosecs;
-  int time_to_run = (bound / 2) * (MAX_INSTANCES / 2);
+  int time_to_run = (bound / 2) * (max_instances / 2 > 0 ? max_instances / 2 : 1);
   time_to_run *= NANOSECS_PER_MILLISEC;
-  dd_time = add_nanosecs_to_clock(dd_time, time_to_run);
-  return dd_time;
+  return nanosecs_to_clock(read_clock_nanosecs(clock_shm) + time_to_run);
 }
 
-static void detect_deadlock(int res_type, int pid) {
-  fprintf(fp,
-          "[%02d:%010d] Running deadlock detection algorithm...\n",
-          clock_shm->secs,
-          clock_shm->nanosecs);
+/**
+ * Runs the deadlock detection algorithm over the wait-for graph.
+ * Kills deadlocked processes, or preempts them, one the victim
+ * policy picks at a time, until no deadlock remains.
+ */
+static void detect_deadlock(void) {
+  int* deadlocked = malloc(sizeof(int) * max_procs);
+  int num_deadlocked = find_deadlocked(&wait_graph,
+                                       res_list,
+                                       proc_list,
+                                       deadlocked);
+  note_detection(num_deadlocked);
+  if (num_deadlocked == 0) {
+    free(deadlocked);
+    return;
+  }
+
+  log_event(LOG_DEADLOCK, -1, -1, num_deadlocked);
 
   int i = 0;
-  struct res_node* res = res_list + res_type;
-  fprintf(fp, "  Processes ");
-  for (; i < MAX_INSTANCES; i++)
-      if (res->held_by[i] != -1)
-        fprintf(fp, "P%02d ", res->held_by[i]);
-  fprintf(fp, "deadlocked\n");
-
-  fprintf(fp, "  Attempting to resolve deadlock...\n");
-  fprintf(fp, "  Killing P%d:\n", pid);
-  int released_res[NUM_RES];
-  release_res(pid, released_res, NUM_RES);
-  print_released_res(released_res, NUM_RES);
-  kill_child(pid);
-  fprintf(fp, "  System is no longer in deadlock\n");
+  for (; i < num_deadlocked; i++)
+    log_event(LOG_DEADLOCKED, deadlocked[i], -1, 0);
+
+  log_event(LOG_RESOLVING, -1, -1, 0);
+  while (num_deadlocked > 0) {
+    uint64_t now = read_clock_nanosecs(clock_shm);
+    int released_res[num_res];
+
+    if (preemption) {
+      // Taking back nothing would break nothing
+      num_deadlocked = keep_exclusive_holders(deadlocked, num_deadlocked);
+    }
+    int pid = select_victim(&victims,
+                            &wait_graph,
+                            res_list,
+                            proc_list,
+                            deadlocked,
+                            num_deadlocked,
+                            now);
+
+    if (preemption) {
+      log_event(LOG_PREEMPT, pid, -1, 0);
+      note_preemption(preempt_res(pid, released_res));
+      print_released_res(released_res, num_res);
+    } else {
+      log_event(LOG_KILL, pid, -1, 0);
+      note_kill(get_proc(proc_list, pid)->num_holds, get_work_lost(&victims, pid, 1, now));
+      remove_waiter(&wait_graph, pid);
+      release_res(pid, released_res, num_res);
+      print_released_res(released_res, num_res);
+      kill_child(pid);
+    }
+
+    num_deadlocked = find_deadlocked(&wait_graph,
+                                     res_list,
+                                     proc_list,
+                                     deadlocked);
+  }
+  log_event(LOG_RESOLVED, -1, -1, 0);
+  free(deadlocked);
 }
 
-static void increment_clock() {
-  clock_shm->nanosecs += 50;
-  if (clock_shm->nanosecs >= NANOSECS_PER_SEC) {
-    clock_shm->secs += 1;
-    clock_shm->nanosecs = 0;
+/**
+ * Narrows deadlocked processes down to those holding exclusive
+ * instances, the only ones preempting can break a deadlock with.
+ * Leaves them all if none do.
+ *
+ * @param deadlocked IDs of the deadlocked processes
+ * @param num_deadlocked Number of deadlocked processes
+ * @return Number of processes left in deadlocked
+ */
+static int keep_exclusive_holders(int* deadlocked, int num_deadlocked) {
+  int num_holders = 0;
+  int i = 0;
+  for (; i < num_deadlocked; i++) {
+    if (get_proc(proc_list, deadlocked[i])->last_hold != -1) {
+      deadlocked[num_holders++] = deadlocked[i];
+    }
   }
+  return num_holders > 0 ? num_holders : num_deadlocked;
+}
+
+/**
+ * Takes back every exclusive instance a deadlocked process holds
+ * and cancels its request, rolling it back to the point it held
+ * only its shared holds. Everything taken, with what it was waiting
+ * for, is left in its request counts for it to re-acquire as a set.
+ *
+ * @param pid The deadlocked process
+ * @param[out] preempted_res Number of instances taken of each resource
+ * @return Number of instances taken
+ */
+static int preempt_res(int pid, int* preempted_res) {
+  struct proc_node* proc = get_proc(proc_list, pid);
+  int* counts = get_request_counts(proc);
+  int num_preempted = 0;
+  int i = 0;
+  for (; i < num_res; i++) {
+    preempted_res[i] = 0;
+  }
+
+  // A set request is already in the counts
+  if (proc->num_requested == 0) {
+    counts[get_waiting_on(&wait_graph, pid)]++;
+  }
+  remove_waiter(&wait_graph, pid);
+  note_proc_unblocked(&victims, pid, read_clock_nanosecs(clock_shm));
+
+  while (proc->last_hold != -1) {
+    struct res_node* res = get_res(res_list, hold_table[proc->last_hold].res_type);
+    drop_last_hold(proc, res, hold_table);
+    if (avoidance) {
+      banker_release(&banker, pid, res->type);
+    }
+    counts[res->type]++;
+    preempted_res[res->type]++;
+    num_preempted++;
+  }
+  advance_shared_clock(clock_shm, 50 * num_preempted);
+
+  proc->num_requested = 0;
+  for (i = 0; i < num_res; i++) {
+    proc->num_requested += counts[i];
+  }
+  proc->preempted = 1;
+  proc->request = -1;
+  num_running++;
+  wake_proc(proc);
+
+  for (i = 0; i < num_res; i++) {
+    // As in release_res(), skip shareable resources
+    if (preempted_res[i] > 0 && !get_res(res_list, i)->shareable) {
+      retry_waiters(get_res(res_list, i));
+      if (avoidance) {
+        break;  // Every waiter was retried
+      }
+    }
+  }
+  return num_preempted;
+}
+
+static void increment_clock() {
+  advance_shared_clock(clock_shm, 50);
 }
 
 static void kill_child(int pid) {
-    kill(children[pid], SIGKILL);
+    if (children[pid] > 0)
+      num_alive--;
+    if (launch == LAUNCH_SIM)
+      end_sim_proc(&sim, pid);
+    else if (children[pid] != VIRTUAL_PID)
+      kill(children[pid], SIGKILL);
     children[pid] = -20;
 }
 
 static void print_released_res(int* released_res, int num_res) {
-  int has_released_res = 0;
   int i = 0;
-  for (; i < num_res; i++)
-    if (released_res[i] != 0)
-      has_released_res = 1;
-
-  if (has_released_res) {
-    fprintf(fp,
-            "    Resources released are as follows: ");
-    i = 0;
+  for (; i < num_res; i++) {
+    if (released_res[i] != 0) {
+      log_event(LOG_RELEASED_RES, -1, i, released_res[i]);
+    }
+  }
+}
+
+/**
+ * Handles a timed event once everyone is asleep.
+ *
+ * @param ev The event
+ */
+static void handle_event(struct event ev) {
+  set_clock(ev.time);
+
+  switch (ev.type) {
+    case FORK: {
+      int k = get_next_available_pid();
+      if (k != -10 && num_procs < max_procs) {
+        launch_child(k);
+        fill_worker_pool();
+        schedule_fork();
+      } else {
+        is_forking = 0;
+      }
+      break;
+    }
+    case WAKE:
+      if (children[ev.pid] > 0) {
+        num_running++;
+        wake_proc(get_proc(proc_list, ev.pid));
+      }
+      break;
+    case DETECT_DEADLOCK:
+      detect_deadlock();
+      // With no one left and no one to come, there's nothing to detect
+      if (num_alive > 0 || is_forking) {
+        schedule_deadlock_detection();
+      }
+      break;
+    case EXPIRE:
+      expire_request(ev.pid, ev.time);
+      break;
+  }
+}
+
+/**
+ * Records a dequeued action to the trace, along with the
+ * maximum claim or the set of instances it refers to.
+ *
+ * @param action The action
+ */
+static void record_action(struct proc_action action) {
+  struct trace_record record = {
+    .time = clock_to_nanosecs(action.time),
+    .type = TRACE_ACTION,
+    .pid = action.pid,
+    .res_type = action.res_type,
+    .kind = action.action
+  };
+  record_trace(&record, sizeof(record));
+
+  if (action.action == CLAIM || action.action == REQUEST_SET) {
+    struct proc_node* proc = get_proc(proc_list, action.pid);
+    char claim[get_claim_size(num_res)];
+    memset(claim, 0, sizeof(claim));
+    memcpy(claim,
+           action.action == CLAIM ? get_max_claim(proc) : get_request_counts(proc),
+           sizeof(int) * num_res);
+    record_trace(claim, sizeof(claim));
+  }
+}
+
+/**
+ * Records a batch of dequeued actions to the trace.
+ *
+ * @param actions The actions
+ * @param num_actions Number of actions in the batch
+ */
+static void record_batch(struct proc_action* actions, int num_actions) {
+  struct trace_record record = {
+    .type = TRACE_BATCH,
+    .kind = num_actions
+  };
+  record_trace(&record, sizeof(record));
+
+  int i = 0;
+  for (; i < num_actions; i++) {
+    record_action(actions[i]);
+  }
+}
+
+/**
+ * Records a popped event to the trace.
+ *
+ * @param ev The event
+ */
+static void record_event(struct event ev) {
+  struct trace_record record = {
+    .time = clock_to_nanosecs(ev.time),
+    .type = TRACE_EVENT,
+    .pid = ev.pid,
+    .kind = ev.type
+  };
+  record_trace(&record, sizeof(record));
+}
+
+/**
+ * Reads an action back from the trace, restoring the maximum
+ * claim or the set of instances it refers to.
+ *
+ * @param record The action's record
+ * @param[out] action The action
+ * @return Where the next record starts
+ */
+static char* replay_action(struct trace_record* record, struct proc_action* action) {
+  char* next = (char*) (record + 1);
+
+  action->pid = record->pid;
+  action->res_type = record->res_type;
+  action->action = record->kind;
+  action->time = nanosecs_to_clock(record->time);
+  action->sent_at = read_wall_nanosecs();
+
+  if (action->action == CLAIM) {
+    memcpy(get_max_claim(get_proc(proc_list, action->pid)), next, sizeof(int) * num_res);
+    next += get_claim_size(num_res);
+  } else if (action->action == REQUEST_SET) {
+    struct proc_node* proc = get_proc(proc_list, action->pid);
+    int* counts = get_request_counts(proc);
+    memcpy(counts, next, sizeof(int) * num_res);
+    next += get_claim_size(num_res);
+
+    proc->num_requested = 0;
+    int i = 0;
     for (; i < num_res; i++) {
-      if (released_res[i] != 0) {
-        fprintf(fp,
-                "R%02d:%d ",
-                i,
-                released_res[i]);
+      proc->num_requested += counts[i];
+    }
+    proc->request = action->res_type;
+  }
+  return next;
+}
+
+/**
+ * Determines whether a replayed action can still happen. It can't
+ * once the replay has diverged from the recording so far that the
+ * process is blocked or gone.
+ *
+ * @param action The action
+ * @return Nonzero if the action can be handled
+ */
+static int is_replayable(struct proc_action action) {
+  if (children[action.pid] > 0 && !is_waiting(&wait_graph, action.pid)) {
+    return 1;
+  }
+  num_divergences++;
+  return 0;
+}
+
+/**
+ * Drives the simulation from a recorded trace instead of children,
+ * then reports how fast it went.
+ */
+static void replay_trace(void) {
+  char* pos = (char*) (replay + 1);
+  char* end = pos + replay->length;
+  struct proc_action actions[ACTION_RING_SIZE];
+  long num_actions = 0;
+  long num_events = 0;
+
+  struct timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (!is_stopping && pos + sizeof(struct trace_record) <= end) {
+    struct trace_record* record = (struct trace_record*) pos;
+
+    if (record->type == TRACE_ACTION) {
+      pos = replay_action(record, actions);
+      if (is_replayable(actions[0])) {
+        handle_action(actions[0]);
+      }
+      num_actions++;
+    } else if (record->type == TRACE_BATCH) {
+      int n = 0;
+      int i = 0;
+      pos = (char*) (record + 1);
+      for (; i < record->kind; i++) {
+        pos = replay_action((struct trace_record*) pos, actions + n);
+        if (is_replayable(actions[n])) {
+          n++;
+        }
       }
+      if (n > 0) {
+        handle_action_batch(actions, n);
+      }
+      num_actions += record->kind;
+    } else if (record->type == TRACE_EVENT) {
+      // Events come from the heap, which the trace should agree with
+      pos = (char*) (record + 1);
+      if (peek_event(&events) == NULL) {
+        num_divergences++;
+        continue;
+      }
+      struct event ev = pop_event(&events);
+      if (ev.type != record->kind ||
+          ev.pid != record->pid ||
+          clock_to_nanosecs(ev.time) != record->time) {
+        num_divergences++;
+      }
+      handle_event(ev);
+      num_events++;
+    } else {
+      break;  // End of a trace that was cut short
     }
-    fprintf(fp, "\n");
   }
-}
\ No newline at end of file
+
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  double elapsed_ms = (stop.tv_sec - start.tv_sec) * 1e3 +
+                      (stop.tv_nsec - start.tv_nsec) / 1e6;
+
+  printf("Replayed %ld actions and %ld events in %.1f ms (%.0f actions/sec)\n",
+         num_actions,
+         num_events,
+         elapsed_ms,
+         num_actions / (elapsed_ms / 1e3));
+  printf("Divergences from the recording: %d\n", num_divergences);
+}
@@ -1,39 +1,104 @@
 #ifndef OSS_H
 #define OSS_H
 
+#include <sys/types.h>
 #include "resource.h"
 #include "myclock.h"
+#include "binlog.h"
+#include "event.h"
+#include "trace.h"
+
+
+/**
+ * How child processes are started.
+ */
+enum launch_mode {
+  LAUNCH_FORK,  // fork() and exec() per child
+  LAUNCH_SPAWN, // posix_spawn() per child
+  LAUNCH_POOL,  // Hand pids to pre-spawned workers
+  LAUNCH_SIM    // Run processes in-process as state machines
+};
 
 static int setup_interrupt(void);
 static int setup_interval_timer(int time);
 static void free_shm(void);
-static void free_shm_and_abort(int s);
+static void stop_run(int s);
+static void print_run_metrics(void);
 static void print_help_message(char* executable_name,
                                char* log_file,
                                char* bound);
 static int is_required_argument(char optopt);
 static void print_required_argument_message(char optopt);
-static void fork_and_exec_child();
-static void init_res_list(struct res_node* res_list);
+static int find_user_path(void);
+static pid_t start_user(int pid, int slot);
+static void fill_worker_pool(void);
+static void launch_child(int index);
+static void init_res_list(struct res_node* res_list, int* num_instances);
 // static void print_res_list(struct res_node* res_list);
 // static void print_res_node(struct res_node node);
 static void init_proc_list(struct proc_node* proc_list);
-static void init_proc_action(struct proc_action* pa);
 static void kill_children();
 static int can_grant_request(int request);
-static int is_proc_action_available(struct proc_action* pa);
-static int has_resource(int pid);
+static void handle_action(struct proc_action action);
+static void handle_request_set(struct proc_action action);
+static void handle_shared_action(struct proc_action action,
+                                 struct proc_node* proc,
+                                 struct res_node* res);
+static void dispatch_action(struct proc_action action);
+static void handle_action_batch(struct proc_action* actions, int num_actions);
+static void print_action_batch(struct proc_action* actions,
+                               enum action_outcome* outcomes,
+                               int num_actions);
+static void log_event(enum log_type type, int pid, int res_type, int count);
+static void log_action(enum log_type type,
+                       struct proc_action action,
+                       enum action_outcome outcome);
+static void write_log_record(struct log_record record);
+static void grant_res(struct proc_node* proc, struct res_node* res);
+static void release_last_res(struct proc_node* proc, struct res_node* res);
+static int find_excess_res(struct proc_node* proc);
+static int find_short_res(struct proc_node* proc);
+static int is_set_grantable(struct proc_node* proc);
+static int get_set_block_res(struct proc_node* proc);
+static void grant_res_set(struct proc_node* proc);
+static int retry_request_set(struct proc_node* proc, struct res_node* res);
+static void block_proc(struct proc_node* proc, struct res_node* res);
+static int can_hand_off(struct res_node* res);
+static void grant_handed_off(struct proc_node* proc, struct res_node* res);
+static int is_request(enum res_action action);
+static void set_wait_deadline(struct proc_node* proc, struct my_clock deadline);
+static void refuse_request(struct proc_node* proc);
+static void expire_request(int pid, struct my_clock deadline);
+static void schedule_expiry(int pid, struct my_clock deadline);
+static int is_grantable(struct proc_node* proc, struct res_node* res);
+static void grant_waiters(struct res_node* res);
+static void retry_waiters(struct res_node* res);
+static void wake_proc(struct proc_node* proc);
+static int resolve_release(struct proc_action* action);
+static void show_res_alloc_table(void);
 static void print_res_alloc_table(void);
-static void reset_term_pid(int* term_pid);
+static void terminate_proc(int pid);
+static int keep_exclusive_holders(int* deadlocked, int num_deadlocked);
+static int preempt_res(int pid, int* preempted_res);
+static void schedule_wake(int pid, struct my_clock time);
+static void schedule_deadlock_detection(void);
+static void schedule_fork(void);
 static void release_res(int pid, int* released_res, int num_res);
-static int is_past_time(struct my_clock myclock);
+static void set_clock(struct my_clock time);
 int get_rand_millisecs(int bound);
 struct my_clock get_time_to_fork();
 static int get_next_available_pid();
 struct my_clock get_time_to_detect_deadlock(int bound);
-static void detect_deadlock(int res_type, int pid);
+static void detect_deadlock(void);
 static void increment_clock(void);
 static void kill_child(int pid);
 static void print_released_res(int* released_res, int num_res);
+static void handle_event(struct event ev);
+static void record_action(struct proc_action action);
+static void record_batch(struct proc_action* actions, int num_actions);
+static void record_event(struct event ev);
+static char* replay_action(struct trace_record* record, struct proc_action* action);
+static int is_replayable(struct proc_action action);
+static void replay_trace(void);
 
 #endif
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ossclient.h"
+#include "futex.h"
+#include "pool.h"
+#include "ring.h"
+
+/**
+ * Attaches to the arena oss launched us with. oss passes our
+ * process ID and the arena's file descriptor, or a pool slot to
+ * wait in until it hands us a process ID.
+ *
+ * @param client The client to fill in
+ * @param argc Argument count, as passed to main()
+ * @param argv Arguments, as passed to main(): pid shm_fd [pool_slot]
+ * @return 0 on success. -1 if the arguments are malformed.
+ */
+int oss_attach(struct oss_client* client, int argc, char* argv[]) {
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "Invalid number of arguments\n");
+    return -1;
+  }
+
+  const int shm_fd = atoi(argv[2]);
+
+  // Everything else about the simulation is in the arena's header
+  client->shm = attach_to_shm_arena(shm_fd);
+  close(shm_fd);
+  init_layout(client->shm->num_res, client->shm->max_instances, client->shm->max_procs);
+
+  client->clock = get_shm_clock(client->shm);
+  client->res_list = get_shm_res_list(client->shm);
+  client->proc_list = get_shm_proc_list(client->shm);
+  client->ring = get_shm_action_ring(client->shm);
+
+  if (argc == 4) {
+    // Pre-spawned worker. Wait for oss to hand us a pid.
+    client->pid = park_worker(get_shm_worker_pool(client->shm), atoi(argv[3]));
+  } else {
+    client->pid = atoi(argv[1]);
+  }
+  client->proc = get_proc(client->proc_list, client->pid);
+  return 0;
+}
+
+/**
+ * Sends an action and sleeps until oss acts on us.
+ */
+static void send_and_wait(struct oss_client* client, struct proc_action action) {
+  int seq = atomic_load(&client->proc->wake_seq);
+  enqueue_action(client->ring, action);
+  while (atomic_load(&client->proc->wake_seq) == seq) {
+    futex_wait(&client->proc->wake_seq, seq);
+  }
+}
+
+/**
+ * Tells oss we're terminating. oss releases everything we hold,
+ * then kills us, so this doesn't return once we're attached. It
+ * sleeps on the action ring like any other call, so it isn't safe
+ * to call from a signal handler.
+ *
+ * @param client The client
+ */
+void oss_detach(struct oss_client* client) {
+  if (client->proc != NULL) {
+    struct proc_action action = { client->pid, -1, TERMINATE };
+    send_and_wait(client, action);
+  }
+
+  if (client->shm != NULL) {
+    detach_from_shm_arena(client->shm);
+  }
+}
+
+/**
+ * @return The simulated time in nanoseconds.
+ */
+uint64_t oss_now(struct oss_client* client) {
+  return read_clock_nanosecs(client->clock);
+}
+
+/**
+ * Asks oss to wake us at a given time and sleeps until it does.
+ *
+ * @param client The client
+ * @param time When to wake up
+ */
+void oss_sleep_until(struct oss_client* client, struct my_clock time) {
+  struct proc_action action = { client->pid, -1, SLEEP, time };
+  send_and_wait(client, action);
+}
+
+/**
+ * Declares the most instances of each resource we'll ever hold at
+ * once, for deadlock avoidance. oss doesn't answer it.
+ *
+ * @param client The client
+ * @param max_claim The maximum claim of each resource
+ */
+void oss_declare_claim(struct oss_client* client, const int* max_claim) {
+  memcpy(get_max_claim(client->proc), max_claim, sizeof(int) * client->shm->num_res);
+  struct proc_action action = { client->pid, -1, CLAIM };
+  enqueue_action(client->ring, action);
+}
+
+/**
+ * Sleeps until oss answers a request.
+ *
+ * oss may resolve a deadlock by preempting us instead: it takes back
+ * every instance we hold and cancels the request. We roll back to
+ * the point we held only our shared holds, and re-acquire everything
+ * it took, with what we were waiting for, as one set.
+ */
+static void wait_for_grant(struct oss_client* client) {
+  struct proc_node* proc = client->proc;
+  while (1) {
+    int seq = atomic_load(&proc->wake_seq);
+    while (((volatile struct proc_node*) proc)->request != -1) {
+      futex_wait(&proc->wake_seq, seq);
+      seq = atomic_load(&proc->wake_seq);
+    }
+    if (!proc->preempted) {
+      return;
+    }
+
+    proc->preempted = 0;
+    int* request_counts = get_request_counts(proc);
+    int i = 0;
+    while (request_counts[i] == 0) {
+      i++;
+    }
+    proc->request = i;
+    struct proc_action action = { client->pid, i, REQUEST_SET };
+    enqueue_action(client->ring, action);
+  }
+}
+
+/**
+ * Sends a request for one instance of a resource and sleeps until
+ * oss answers it.
+ *
+ * @return 1 if it was granted, 0 if oss turned it down
+ */
+static int send_request(struct oss_client* client, struct proc_action action) {
+  client->proc->refused = 0;
+  client->proc->request = action.res_type;
+  enqueue_action(client->ring, action);
+
+  wait_for_grant(client);
+  return !client->proc->refused;
+}
+
+/**
+ * Requests an instance of a resource, waiting as long as it takes.
+ *
+ * @param client The client
+ * @param res_type The resource
+ */
+void oss_acquire(struct oss_client* client, int res_type) {
+  struct proc_action action = { client->pid, res_type, REQUEST };
+  send_request(client, action);
+}
+
+/**
+ * Requests an instance of a resource only if oss can grant it now.
+ *
+ * @param client The client
+ * @param res_type The resource
+ * @return 1 if it was granted, 0 if none were free
+ */
+int oss_try_acquire(struct oss_client* client, int res_type) {
+  struct proc_action action = { client->pid, res_type, TRY_REQUEST };
+  return send_request(client, action);
+}
+
+/**
+ * Requests an instance of a resource, giving up at a deadline.
+ *
+ * @param client The client
+ * @param res_type The resource
+ * @param deadline When oss gives up on the request
+ * @return 1 if it was granted, 0 if the deadline passed first
+ */
+int oss_acquire_until(struct oss_client* client, int res_type, struct my_clock deadline) {
+  struct proc_action action = { client->pid, res_type, REQUEST_UNTIL, deadline };
+  return send_request(client, action);
+}
+
+/**
+ * Requests a set of instances all at once. oss grants every
+ * instance in it or none, so we never hold some while waiting on
+ * the rest. oss can't do that when threads grant requests, since
+ * a set can span their shards.
+ *
+ * @param client The client
+ * @param counts How many instances of each resource to request
+ * @return 0 if the set was empty. -1 if oss was started with threads.
+ */
+int oss_acquire_many(struct oss_client* client, const int* counts) {
+  if (client->shm->num_threads > 0) {
+    return -1;
+  }
+
+  struct proc_node* proc = client->proc;
+  int* request_counts = get_request_counts(proc);
+  int num_requested = 0;
+  int first = -1;
+  int i = 0;
+  for (; i < client->shm->num_res; i++) {
+    request_counts[i] = counts[i];
+    num_requested += counts[i];
+    if (first == -1 && counts[i] > 0) {
+      first = i;
+    }
+  }
+  if (num_requested == 0) {
+    return 0;
+  }
+
+  proc->num_requested = num_requested;
+  proc->request = first;
+  struct proc_action action = { client->pid, first, REQUEST_SET };
+  enqueue_action(client->ring, action);
+
+  wait_for_grant(client);
+  return 1;
+}
+
+/**
+ * Releases our most recent exclusive hold, or else one of our
+ * shared holds, and sleeps until oss has taken it back.
+ *
+ * @param client The client
+ * @return 0 if we held nothing
+ */
+int oss_release(struct oss_client* client) {
+  struct proc_node* proc = client->proc;
+  int num_holds = proc->num_holds;
+  if (num_holds == 0) {
+    return 0;
+  }
+
+  struct proc_action action = { client->pid, get_release_res(proc, client->res_list), RELEASE };
+  enqueue_action(client->ring, action);
+
+  // Dropping our hold count is oss's answer
+  int seq = atomic_load(&proc->wake_seq);
+  while (((volatile struct proc_node*) proc)->num_holds == num_holds) {
+    futex_wait(&proc->wake_seq, seq);
+    seq = atomic_load(&proc->wake_seq);
+  }
+  return 1;
+}
+
+/**
+ * @return Number of instances and shared holds we hold.
+ */
+int oss_num_holds(struct oss_client* client) {
+  return client->proc->num_holds;
+}
+
+/**
+ * @return Number of instances of a resource we hold.
+ */
+int oss_num_held(struct oss_client* client, int res_type) {
+  return get_hold_counts(client->proc)[res_type];
+}
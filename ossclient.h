@@ -0,0 +1,46 @@
+#ifndef OSSCLIENT_H
+#define OSSCLIENT_H
+
+#include <stdint.h>
+#include "ossshm.h"
+#include "myclock.h"
+#include "resource.h"
+
+/*
+ * OSS Client Library
+ *
+ * The child side of the oss protocol, built as libossclient.a.
+ * A client attaches to the arena oss hands it, then asks for and
+ * gives back resources through calls that sleep until oss answers.
+ * How actions reach oss and how the client is woken stay behind
+ * this interface, so they can change without touching the
+ * programs linked against it.
+ *-----------------------------------------------------------------*/
+
+struct oss_client {
+  int pid;                        // Simulated process ID oss gave us
+  struct shm_header* shm;         // Settings oss was started with
+  struct shared_clock* clock;
+  struct res_node* res_list;
+  struct proc_node* proc;         // Our own process node
+  struct proc_node* proc_list;
+  struct action_ring* ring;
+};
+
+int oss_attach(struct oss_client* client, int argc, char* argv[]);
+void oss_detach(struct oss_client* client);
+
+uint64_t oss_now(struct oss_client* client);
+void oss_sleep_until(struct oss_client* client, struct my_clock time);
+void oss_declare_claim(struct oss_client* client, const int* max_claim);
+
+void oss_acquire(struct oss_client* client, int res_type);
+int oss_try_acquire(struct oss_client* client, int res_type);
+int oss_acquire_until(struct oss_client* client, int res_type, struct my_clock deadline);
+int oss_acquire_many(struct oss_client* client, const int* counts);
+int oss_release(struct oss_client* client);
+
+int oss_num_holds(struct oss_client* client);
+int oss_num_held(struct oss_client* client, int res_type);
+
+#endif
@@ -1,241 +1,210 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "ossshm.h"
 
-/**
- * Allocates shared memory for a simulated clock.
- * 
- * @return The shared memory segment ID
- */
-int get_clock_shm(void) {
-  int id = shmget(IPC_PRIVATE, sizeof(struct my_clock),
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
-  if (id == -1) {
-    perror("Failed to get shared memory for clock");
-    exit(EXIT_FAILURE);
-  }
-  return id;
+static size_t round_up(size_t size, size_t align) {
+  return (size + align - 1) / align * align;
 }
 
 /**
- * Attaches to the clock shared memory segment.
- * 
- * @return A pointer to the clock in shared memory.
+ * Lays out the arena's regions after the header, each starting
+ * on its own cache line. The resource layout must already be
+ * initialized.
+ *
+ * @param header Header to fill in the offsets and size of
+ * @param total_instances Number of instances across all resources
+ * @return The size of the arena in bytes
  */
-struct my_clock* attach_to_clock_shm(int id) {
-  void* clock_shm = shmat(id, NULL, 0);
+size_t plan_shm_arena(struct shm_header* header, int total_instances) {
+  size_t offset = round_up(sizeof(struct shm_header), CACHE_LINE_SIZE);
 
-  if (*((int*) clock_shm) == -1) {
-    perror("Failed to attach to clock shared memory");
-    exit(EXIT_FAILURE);
-  }
+  header->magic = SHM_MAGIC;
 
-  return (struct my_clock*) clock_shm;
-}
+  header->clock_offset = offset;
+  offset = round_up(offset + sizeof(struct shared_clock), CACHE_LINE_SIZE);
 
-/**
- * Detaches from clock shared memory.
- * 
- * @param Clock shared memory
- * @return On success, 0. On error -1.
- */
-int detach_from_clock_shm(struct my_clock* shm) {
-  int success = shmdt(shm);
-  if (success == -1) {
-    perror("Failed to detach from clock shared memory");
-  }
-  return success;
-}
+  header->res_list_offset = offset;
+  offset = round_up(offset + get_res_list_size(total_instances), CACHE_LINE_SIZE);
 
+  header->proc_list_offset = offset;
+  offset = round_up(offset + get_proc_list_size(), CACHE_LINE_SIZE);
 
-/**
- * Allocates shared memory for a list of resources.
- * 
- * @return The shared memory segment ID
- */
-int get_res_list(int num_res) {
-  int size = sizeof(struct res_node) * num_res;
-  int id = shmget(IPC_PRIVATE, size,
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+  header->action_ring_offset = offset;
+  offset = round_up(offset + sizeof(struct action_ring), CACHE_LINE_SIZE);
 
-  if (id == -1) {
-    perror("Failed to get shared memory for resource list");
-    exit(EXIT_FAILURE);
-  }
-  return id;
+  header->worker_pool_offset = offset;
+  offset = round_up(offset + get_worker_pool_size(header->pool_size), CACHE_LINE_SIZE);
+
+  header->stats_offset = offset;
+  offset = round_up(offset + get_stats_size(header->num_res, header->num_threads + 1), CACHE_LINE_SIZE);
+
+  header->size = offset;
+  return offset;
 }
 
 /**
- * Attaches to resource list shared memory segment.
- * 
- * @return A pointer to a resource list in shared memory.
+ * Opens an anonymous shared memory file that survives exec.
+ * Falls back to a POSIX shared memory object, unlinked right away,
+ * on kernels without memfd_create().
+ *
+ * @param flags Extra memfd_create() flags
+ * @return The file descriptor. -1 on error.
  */
-struct res_node* attach_to_res_list(int id) {
-  void* shm = shmat(id, NULL, 0);
+static int open_arena_fd(unsigned int flags) {
+  int fd = memfd_create("oss", flags);
+  if (fd != -1 || errno != ENOSYS || flags != 0) {
+    return fd;
+  }
 
-  if (*((int*) shm) == -1) {
-    perror("Failed to attach to shared memory for resource list");
-    exit(EXIT_FAILURE);
+  char name[32];
+  snprintf(name, sizeof(name), "/oss-%d", getpid());
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    return -1;
   }
+  shm_unlink(name);
 
-  return (struct res_node*) shm;
+  // shm_open() sets close-on-exec, but children need the descriptor
+  fcntl(fd, F_SETFD, 0);
+  return fd;
 }
 
 /**
- * Detaches from resource list in shared memory.
- * 
- * @param Resource list in shared memory
- * @return On success, 0. On error -1.
+ * Creates and maps a new arena file.
+ *
+ * @param size Size of the arena in bytes
+ * @param flags Extra memfd_create() flags
+ * @param fd Set to the arena's file descriptor
+ * @return The mapping. MAP_FAILED on error.
  */
-int detach_from_res_list(struct res_node* shm) {
-  int success = shmdt(shm);
-  if (success == -1) {
-    perror("Failed to detach from shared memory for resource list");
-  }
-  return success;
-}
+static void* map_new_arena(size_t size, unsigned int flags, int* fd) {
+  void* shm = MAP_FAILED;
 
+  *fd = open_arena_fd(flags);
+  if (*fd == -1) {
+    return MAP_FAILED;
+  }
 
-/**
- * Allocates shared memory for process list.
- * 
- * @return The shared memory segment ID
- */
-int get_proc_list(int num_procs) {
-  int size = sizeof(struct proc_node) * num_procs;
-  int id = shmget(IPC_PRIVATE, size,
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+  if (ftruncate(*fd, size) == 0) {
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, *fd, 0);
+  }
 
-  if (id == -1) {
-    perror("Failed to get shared memory for process list");
-    exit(EXIT_FAILURE);
+  if (shm == MAP_FAILED) {
+    close(*fd);
   }
-  return id;
+  return shm;
 }
 
 /**
- * Attaches to process list shared memory segment.
- * 
- * @return A pointer to a list of process nodes in shared memory.
+ * Allocates the shared memory arena and copies the header into it.
+ * With huge pages the arena is backed by hugetlbfs if the system
+ * has any reserved, and by normal pages otherwise.
+ *
+ * @param header A header filled in by plan_shm_arena()
+ * @param huge_pages Non-zero to try backing the arena with huge pages
+ * @param fd Set to the file descriptor children attach with
+ * @return A pointer to the arena
  */
-struct proc_node* attach_to_proc_list(int id) {
-  void* shm = shmat(id, NULL, 0);
+struct shm_header* create_shm_arena(struct shm_header* header,
+                                    int huge_pages,
+                                    int* fd) {
+  void* shm = MAP_FAILED;
+
+  if (huge_pages) {
+    size_t size = round_up(header->size, HUGE_PAGE_SIZE);
+    shm = map_new_arena(size, MFD_HUGETLB, fd);
+    if (shm != MAP_FAILED) {
+      header->size = size;
+    } else {
+      fprintf(stderr, "Huge pages unavailable, using normal pages\n");
+    }
+  }
+
+  if (shm == MAP_FAILED) {
+    shm = map_new_arena(header->size, 0, fd);
+  }
 
-  if (*((int*) shm) == -1) {
-    perror("Failed to attach to shared memory for process list");
+  if (shm == MAP_FAILED) {
+    perror("Failed to create shared memory arena");
     exit(EXIT_FAILURE);
   }
 
-  return (struct proc_node*) shm;
+  memcpy(shm, header, sizeof(struct shm_header));
+  return (struct shm_header*) shm;
 }
 
 /**
- * Detaches from process list in shared memory.
- * 
- * @param Process list in shared memory
- * @return On success, 0. On error -1.
+ * Attaches to the shared memory arena.
+ *
+ * @param fd The arena's file descriptor
+ * @return A pointer to the arena
  */
-int detach_from_proc_list(struct proc_node* shm) {
-  int success = shmdt(shm);
-  if (success == -1) {
-    perror("Failed to detach from process list shared memory");
+struct shm_header* attach_to_shm_arena(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("Failed to stat shared memory arena");
+    exit(EXIT_FAILURE);
   }
-  return success;
-}
 
-/**
- * Allocates shared memory for a process action.
- * 
- * @return The shared memory segment ID
- */
-int get_proc_action() {
-  int id = shmget(IPC_PRIVATE, sizeof(struct proc_action),
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
-
-  if (id == -1) {
-    perror("Failed to get shared memory for process action");
+  void* shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (shm == MAP_FAILED) {
+    perror("Failed to attach to shared memory arena");
     exit(EXIT_FAILURE);
   }
-  return id;
-}
-
-/**
- * Attaches to a process action shared memory segment.
- * 
- * @return A pointer to a process action in shared memory.
- */
-struct proc_action* attach_to_proc_action(int id) {
-  void* shm = shmat(id, NULL, 0);
 
-  if (*((int*) shm) == -1) {
-    perror("Failed to attach to shared memory for process action");
+  if (((struct shm_header*) shm)->magic != SHM_MAGIC) {
+    fprintf(stderr, "Shared memory arena has a bad header\n");
     exit(EXIT_FAILURE);
   }
 
-  return (struct proc_action*) shm;
+  return (struct shm_header*) shm;
 }
 
 /**
- * Detaches from process action in shared memory.
- * 
- * @param Process action in shared memory
+ * Detaches from the shared memory arena.
+ *
+ * @param shm The arena
  * @return On success, 0. On error -1.
  */
-int detach_from_proc_action(struct proc_action* shm) {
-  int success = shmdt(shm);
+int detach_from_shm_arena(struct shm_header* shm) {
+  int success = munmap(shm, shm->size);
   if (success == -1) {
-    perror("Failed to detach from process action shared memory");
+    perror("Failed to detach from shared memory arena");
   }
   return success;
 }
 
-/**
- * Allocates shared memory for an integer.
- * 
- * @return The shared memory segment ID
- */
-int get_int_shm(void) {
-  int id = shmget(IPC_PRIVATE, sizeof(int),
-    IPC_CREAT | IPC_EXCL | S_IRUSR | S_IWUSR);
+struct shared_clock* get_shm_clock(struct shm_header* shm) {
+  return (struct shared_clock*) ((char*) shm + shm->clock_offset);
+}
 
-  if (id == -1) {
-    perror("Failed to get shared memory for int");
-    exit(EXIT_FAILURE);
-  }
-  return id;
+struct res_node* get_shm_res_list(struct shm_header* shm) {
+  return (struct res_node*) ((char*) shm + shm->res_list_offset);
 }
 
-/**
- * Attaches to an int shared memory segment.
- * 
- * @return A pointer to an int in shared memory.
- */
-int* attach_to_int_shm(int id) {
-  int* shm = shmat(id, NULL, 0);
+struct proc_node* get_shm_proc_list(struct shm_header* shm) {
+  return (struct proc_node*) ((char*) shm + shm->proc_list_offset);
+}
 
-  if (*shm == -1) {
-    perror("Failed to attach to int shared memory");
-    exit(EXIT_FAILURE);
-  }
+struct action_ring* get_shm_action_ring(struct shm_header* shm) {
+  return (struct action_ring*) ((char*) shm + shm->action_ring_offset);
+}
 
-  return shm;
+struct worker_pool* get_shm_worker_pool(struct shm_header* shm) {
+  return (struct worker_pool*) ((char*) shm + shm->worker_pool_offset);
 }
 
-/**
- * Detaches from an int in shared memory.
- * 
- * @param Int shared memory
- * @return On success, 0. On error -1.
- */
-int detach_from_int_shm(int* shm) {
-  int success = shmdt(shm);
-  if (success == -1) {
-    perror("Failed to detach from int shared memory");
-  }
-  return success;
+struct oss_stats* get_shm_stats(struct shm_header* shm) {
+  return (struct oss_stats*) ((char*) shm + shm->stats_offset);
 }
@@ -1,32 +1,57 @@
 #ifndef OSSSHM_H
 #define OSSSHM_H
 
+#include <stddef.h>
 #include "myclock.h"
 #include "resource.h"
+#include "ring.h"
+#include "cacheline.h"
+#include "pool.h"
+#include "metrics.h"
 
 /*
  * Operating System Simulator Shared Memory
- *-----------------------------------------*/
-
-int get_clock_shm(void);
-struct my_clock* attach_to_clock_shm(int id);
-int detach_from_clock_shm(struct my_clock* shm);
-
-int get_res_list(int num_res);
-struct res_node* attach_to_res_list(int id);
-int detach_from_res_list(struct res_node* shm);
-
-int get_proc_list(int num_proc);
-struct proc_node* attach_to_proc_list(int id);
-int detach_from_proc_list(struct proc_node* shm);
-
-int get_proc_action();
-struct proc_action* attach_to_proc_action(int id);
-int detach_from_proc_action(struct proc_action* shm);
-
-int get_int_shm();
-int* attach_to_int_shm(int id);
-int detach_from_int_shm(int* shm);
-
+ *
+ * Everything shared between oss and its children lives in one
+ * arena: a header describing the simulation and where each region
+ * starts, followed by the regions themselves, each aligned to a
+ * cache line. Children inherit the arena's file descriptor.
+ *-----------------------------------------------------------------*/
+
+#define SHM_MAGIC 0x4f535321  // "OSS!"
+
+struct shm_header {
+  unsigned int magic;
+  int num_res;               // Sizes children need for init_layout()
+  int max_instances;
+  int max_procs;
+  int bound;                 // Request / release bound in milliseconds
+  int avoidance;             // Non-zero with the banker's algorithm
+  int pool_size;             // Slots for pre-spawned workers
+  int num_threads;           // Threads granting requests, besides oss's own
+  int request_timeout;       // Milliseconds a child holding resources waits, or -1
+  unsigned long seed;        // Children seed with this plus their pid
+  size_t size;               // Bytes mapped, including this header
+  size_t clock_offset;       // Region offsets from the header
+  size_t res_list_offset;
+  size_t proc_list_offset;
+  size_t action_ring_offset;
+  size_t worker_pool_offset;
+  size_t stats_offset;
+};
+
+size_t plan_shm_arena(struct shm_header* header, int total_instances);
+struct shm_header* create_shm_arena(struct shm_header* header,
+                                    int huge_pages,
+                                    int* fd);
+struct shm_header* attach_to_shm_arena(int fd);
+int detach_from_shm_arena(struct shm_header* shm);
+
+struct shared_clock* get_shm_clock(struct shm_header* shm);
+struct res_node* get_shm_res_list(struct shm_header* shm);
+struct proc_node* get_shm_proc_list(struct shm_header* shm);
+struct action_ring* get_shm_action_ring(struct shm_header* shm);
+struct worker_pool* get_shm_worker_pool(struct shm_header* shm);
+struct oss_stats* get_shm_stats(struct shm_header* shm);
 
 #endif
@@ -0,0 +1,72 @@
+#include "futex.h"
+#include "pool.h"
+
+/**
+ * @return Bytes needed for a pool with the given number of slots.
+ */
+size_t get_worker_pool_size(int num_slots) {
+  return sizeof(struct worker_pool) + sizeof(struct pool_slot) * num_slots;
+}
+
+/**
+ * Initializes a pool with every slot empty.
+ *
+ * @param pool The pool in shared memory
+ * @param num_slots Number of slots
+ */
+void init_worker_pool(struct worker_pool* pool, int num_slots) {
+  pool->num_slots = num_slots;
+  int i = 0;
+  for (; i < num_slots; i++) {
+    atomic_init(&pool->slots[i].state, SLOT_EMPTY);
+  }
+}
+
+/**
+ * Finds a worker ready to be handed a pid. Only oss may call this.
+ *
+ * @param pool The pool
+ * @return The worker's slot. -1 if no worker is parked.
+ */
+int find_parked_worker(struct worker_pool* pool) {
+  int i = 0;
+  for (; i < pool->num_slots; i++) {
+    if (atomic_load(&pool->slots[i].state) == SLOT_PARKED) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Hands a parked worker its pid and wakes it. Only oss may call this.
+ *
+ * @param pool The pool
+ * @param slot The worker's slot
+ * @param pid The pid the worker runs as
+ */
+void assign_worker(struct worker_pool* pool, int slot, int pid) {
+  atomic_store(&pool->slots[slot].state, pid);
+  futex_wake(&pool->slots[slot].state, 1);
+}
+
+/**
+ * Parks a worker until oss hands it a pid, then frees the slot
+ * so oss can start a replacement.
+ *
+ * @param pool The pool
+ * @param slot The worker's slot
+ * @return The pid assigned
+ */
+int park_worker(struct worker_pool* pool, int slot) {
+  atomic_int* state = &pool->slots[slot].state;
+  atomic_store(state, SLOT_PARKED);
+
+  int pid;
+  while ((pid = atomic_load(state)) < 0) {
+    futex_wait(state, pid);
+  }
+
+  atomic_store(state, SLOT_EMPTY);
+  return pid;
+}
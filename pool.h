@@ -0,0 +1,35 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include "cacheline.h"
+
+// States of a pool slot. Anything else is the pid it was assigned.
+#define SLOT_EMPTY    -1  // No worker, or the worker has taken its pid
+#define SLOT_STARTING -2  // Worker spawned but not parked yet
+#define SLOT_PARKED   -3  // Worker parked, waiting for a pid
+
+/*
+ * A slot a pre-spawned user process parks in until oss hands it
+ * a pid. Each slot has its own cache line.
+ */
+struct pool_slot {
+  atomic_int state;
+} CACHE_ALIGNED;
+
+/*
+ * Pool of parked user processes in shared memory
+ * ----------------------------------------------*/
+struct worker_pool {
+  int num_slots;
+  struct pool_slot slots[];
+};
+
+size_t get_worker_pool_size(int num_slots);
+void init_worker_pool(struct worker_pool* pool, int num_slots);
+int find_parked_worker(struct worker_pool* pool);
+void assign_worker(struct worker_pool* pool, int slot, int pid);
+int park_worker(struct worker_pool* pool, int slot);
+
+#endif
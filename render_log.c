@@ -0,0 +1,224 @@
+/**
+ * Renders a binary oss log in the text format oss used to write.
+ *
+ * Usage: render_log [log_file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binlog.h"
+#include "myclock.h"
+#include "resource.h"
+
+static int num_res;
+
+// Row of the allocation table being collected, if any
+static int row_pid = -1;
+static int* row_counts;
+
+// Set while printing a list of released resources
+static int in_released = 0;
+
+static void print_time(uint64_t time) {
+  struct my_clock clock = nanosecs_to_clock(time);
+  printf("[%02d:%010d] ", clock.secs, clock.nanosecs);
+}
+
+static void print_row(void) {
+  printf("P%02d  ", row_pid);
+  int i = 0;
+  for (; i < num_res; i++) {
+    printf("%02d  ", row_counts[i]);
+  }
+  printf("\n");
+  row_pid = -1;
+}
+
+static char* get_outcome_str(int outcome) {
+  switch (outcome) {
+    case GRANTED:
+      return "granted";
+    case RELEASED:
+      return "released";
+    case BLOCKED:
+      return "blocked";
+    case REFUSED:
+      return "refused";
+    default:
+      return "ignored";
+  }
+}
+
+/**
+ * Lines that span records, the released resources and the rows of
+ * the allocation table, end when a record of another type comes along.
+ *
+ * @param next_type Type of the next record, or -1 at the end of the log
+ */
+static void finish_lines(int next_type) {
+  if (in_released && next_type != LOG_RELEASED_RES) {
+    printf("\n");
+    in_released = 0;
+  }
+  if (row_pid != -1 && next_type != LOG_ALLOC_HOLD) {
+    print_row();
+  }
+}
+
+/**
+ * Prints one record.
+ */
+static void render_record(struct log_record* r) {
+  finish_lines(r->type);
+
+  char* action_str = r->action == RELEASE ? "release" : "claim";
+  int i = 0;
+
+  switch (r->type) {
+    case LOG_REQUEST:
+      print_time(r->time);
+      if (r->action == REQUEST_SET) {
+        printf("Detected P%02d request to claim a set of resources\n", r->pid);
+      } else if (r->action == TRY_REQUEST) {
+        printf("Detected P%02d request to try to claim R%02d\n", r->pid, r->res_type);
+      } else if (r->action == REQUEST_UNTIL) {
+        printf("Detected P%02d timed request to claim R%02d\n", r->pid, r->res_type);
+      } else {
+        printf("Detected P%02d request to %s R%02d\n", r->pid, action_str, r->res_type);
+      }
+      break;
+    case LOG_EXCEEDS_CLAIM:
+      print_time(r->time);
+      printf("P%02d request for R%02d exceeds its maximum claim\n", r->pid, r->res_type);
+      break;
+    case LOG_GRANT:
+      print_time(r->time);
+      if (r->count > 1) {
+        printf("Granting P%02d request for %d of R%02d\n", r->pid, r->count, r->res_type);
+      } else {
+        printf("Granting P%02d request for R%02d\n", r->pid, r->res_type);
+      }
+      break;
+    case LOG_RELEASE:
+      print_time(r->time);
+      printf("Granting P%02d request to release R%02d\n", r->pid, r->res_type);
+      break;
+    case LOG_BLOCK:
+      print_time(r->time);
+      printf("Blocking P%02d until R%02d is released\n", r->pid, r->res_type);
+      break;
+    case LOG_REFUSE:
+      print_time(r->time);
+      printf("Refusing P%02d request for R%02d, none are free\n", r->pid, r->res_type);
+      break;
+    case LOG_EXPIRE:
+      print_time(r->time);
+      printf("Expiring P%02d request for R%02d, its deadline has passed\n", r->pid, r->res_type);
+      break;
+    case LOG_TERMINATE:
+      print_time(r->time);
+      printf("Detected P%02d is terminating\n", r->pid);
+      break;
+    case LOG_RELEASED_RES:
+      if (!in_released) {
+        printf("    Resources released are as follows: ");
+        in_released = 1;
+      }
+      printf("R%02d:%d ", r->res_type, r->count);
+      break;
+    case LOG_BATCH:
+      print_time(r->time);
+      printf("Dispatching batch of %d actions\n", r->count);
+      break;
+    case LOG_BATCH_ACTION:
+      if (r->outcome == TERMINATED) {
+        printf("  P%02d terminated\n", r->pid);
+      } else if (r->action == REQUEST_SET) {
+        printf("  P%02d request to claim a set %s\n", r->pid, get_outcome_str(r->outcome));
+      } else {
+        printf("  P%02d request to %s R%02d %s\n",
+               r->pid,
+               action_str,
+               r->res_type,
+               get_outcome_str(r->outcome));
+      }
+      break;
+    case LOG_DEADLOCK:
+      print_time(r->time);
+      printf("Running deadlock detection algorithm...\n");
+      printf("  Processes ");
+      break;
+    case LOG_DEADLOCKED:
+      printf("P%02d ", r->pid);
+      break;
+    case LOG_RESOLVING:
+      printf("deadlocked\n");
+      printf("  Attempting to resolve deadlock...\n");
+      break;
+    case LOG_KILL:
+      printf("  Killing P%d:\n", r->pid);
+      break;
+    case LOG_PREEMPT:
+      printf("  Preempting P%d:\n", r->pid);
+      break;
+    case LOG_RESOLVED:
+      printf("  System is no longer in deadlock\n");
+      break;
+    case LOG_ALLOC_TABLE:
+      printf("\n    ");
+      for (i = 0; i < num_res; i++)
+        printf("R%02d ", i);
+      printf("\n");
+      for (i = 0; i < ((num_res + 1) * 4); i++)
+        printf("-");
+      printf("\n");
+      break;
+    case LOG_ALLOC_ROW:
+      row_pid = r->pid;
+      memset(row_counts, 0, sizeof(int) * num_res);
+      break;
+    case LOG_ALLOC_HOLD:
+      row_counts[r->res_type] = r->count;
+      break;
+    case LOG_ALLOC_END:
+      printf("\n");
+      break;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  char* log_file = argc > 1 ? argv[1] : "oss.out";
+
+  FILE* fp = fopen(log_file, "r");
+  if (fp == NULL) {
+    perror("Failed to open log file");
+    return EXIT_FAILURE;
+  }
+
+  struct binlog_header header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      strncmp(header.magic, BINLOG_MAGIC, sizeof(header.magic)) != 0 ||
+      header.record_size != sizeof(struct log_record)) {
+    fprintf(stderr, "%s is not an oss log\n", log_file);
+    return EXIT_FAILURE;
+  }
+
+  num_res = header.num_res;
+  row_counts = malloc(sizeof(int) * num_res);
+
+  struct log_record records[1024];
+  size_t num_records;
+  while ((num_records = fread(records, sizeof(struct log_record), 1024, fp)) > 0) {
+    size_t i = 0;
+    for (; i < num_records; i++) {
+      render_record(records + i);
+    }
+  }
+
+  finish_lines(-1);
+
+  free(row_counts);
+  fclose(fp);
+  return EXIT_SUCCESS;
+}
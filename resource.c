@@ -1,4 +1,121 @@
+#include <string.h>
 #include "resource.h"
+#include "cacheline.h"
+
+#define BITS_PER_WORD 64
+
+static int num_res_types = 0;
+static int num_proc_ids = 0;
+static int num_mask_words = 0;
+static size_t res_stride = 0;
+static size_t proc_stride = 0;
+
+static size_t round_up(size_t size, size_t align) {
+  return (size + align - 1) / align * align;
+}
+
+/**
+ * Sets the sizes the resource and process lists are laid out with.
+ * Every process attaching to the lists must call this first with
+ * the same arguments.
+ *
+ * @param num_res Number of resources
+ * @param max_instances Most instances a resource can have
+ * @param max_procs Number of process IDs
+ */
+void init_layout(int num_res, int max_instances, int max_procs) {
+  num_res_types = num_res;
+  num_proc_ids = max_procs;
+  num_mask_words = (max_instances + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+  // Padded, every resource node starts on a cache line of its own,
+  // with its hot fields starting the next. Packed, nodes only keep
+  // their 8-byte alignment and may straddle lines.
+  res_stride = round_up(offsetof(struct res_node, free_mask) +
+                        num_mask_words * sizeof(uint64_t),
+                        NODE_ALIGN_SIZE);
+
+  // oss wakes one process while others poll theirs, so each
+  // process node starts on a cache line of its own
+  proc_stride = round_up(sizeof(struct proc_node) +
+                         num_res * (2 * sizeof(int) + sizeof(unsigned short)),
+                         NODE_ALIGN_SIZE);
+}
+
+/**
+ * @return Bytes needed for the resource list and its hold table.
+ */
+size_t get_res_list_size(int total_instances) {
+  return res_stride * num_res_types + sizeof(struct hold) * total_instances;
+}
+
+/**
+ * @return Bytes needed for the process list.
+ */
+size_t get_proc_list_size(void) {
+  return proc_stride * num_proc_ids;
+}
+
+struct res_node* get_res(struct res_node* res_list, int i) {
+  return (struct res_node*) ((char*) res_list + res_stride * i);
+}
+
+struct proc_node* get_proc(struct proc_node* proc_list, int pid) {
+  return (struct proc_node*) ((char*) proc_list + proc_stride * pid);
+}
+
+/**
+ * @return The hold table, which follows the last resource node.
+ */
+struct hold* get_hold_table(struct res_node* res_list) {
+  return (struct hold*) get_res(res_list, num_res_types);
+}
+
+/**
+ * @return The process's maximum claim of each resource.
+ */
+int* get_max_claim(struct proc_node* proc) {
+  return (int*) (proc + 1);
+}
+
+/**
+ * @return How many instances of each resource the process is
+ *         requesting as a set.
+ */
+int* get_request_counts(struct proc_node* proc) {
+  return get_max_claim(proc) + num_res_types;
+}
+
+/**
+ * @return How many instances of each resource the process holds.
+ */
+unsigned short* get_hold_counts(struct proc_node* proc) {
+  return (unsigned short*) (get_request_counts(proc) + num_res_types);
+}
+
+/**
+ * Marks every instance of a resource as free
+ *
+ * @param res The resource
+ * @param first_instance Index of the resource's first instance in holds
+ * @param holds The hold table
+ */
+void init_res_instances(struct res_node* res,
+                        unsigned int first_instance,
+                        struct hold* holds) {
+  res->num_allocated = 0;
+  res->num_readers = 0;
+  res->first_instance = first_instance;
+  memset(res->free_mask, 0, num_mask_words * sizeof(uint64_t));
+
+  unsigned int k = 0;
+  for (; k < res->num_instances; k++) {
+    res->free_mask[k / BITS_PER_WORD] |= 1ull << (k % BITS_PER_WORD);
+    holds[first_instance + k].res_type = res->type;
+    holds[first_instance + k].pid = -1;
+    holds[first_instance + k].next = -1;
+  }
+}
 
 /**
  * Gets a resource instance
@@ -8,15 +125,202 @@
  * @return -1 if no instances are available
  */
 int get_res_instance(struct res_node* res) {
-  // Find next available index
-  int k = 0;
-  while (res->held_by[k] != -1 && k < MAX_INSTANCES) {
-    k++;
+  int w = 0;
+  for (; w < num_mask_words; w++) {
+    if (res->free_mask[w] != 0) {
+      return w * BITS_PER_WORD + __builtin_ffsll(res->free_mask[w]) - 1;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Claims a free resource instance for a process
+ *
+ * @param res The requested resource
+ * @param holds The hold table
+ * @param pid The ID of the claiming process
+ *
+ * @return Index of the claimed instance in the hold table.
+ *         -1 if no instances are available
+ */
+int claim_res_instance(struct res_node* res, struct hold* holds, int pid) {
+  int k = get_res_instance(res);
+  if (k == -1) {
+    return -1;
   }
+  res->free_mask[k / BITS_PER_WORD] &= ~(1ull << (k % BITS_PER_WORD));
+  res->num_allocated++;
+  int i = res->first_instance + k;
+  holds[i].pid = pid;
+  return i;
+}
 
-  if (k == MAX_INSTANCES) {
-    return -1; // No more instances available
-  } else {
-    return k;
+/**
+ * Frees a claimed resource instance
+ *
+ * @param res The resource
+ * @param holds The hold table
+ * @param i Index of the instance in the hold table
+ */
+void free_res_instance(struct res_node* res, struct hold* holds, int i) {
+  int k = i - res->first_instance;
+  res->free_mask[k / BITS_PER_WORD] |= 1ull << (k % BITS_PER_WORD);
+  res->num_allocated--;
+  holds[i].pid = -1;
+  holds[i].next = -1;
+}
+
+/**
+ * Gives a process a free instance of a resource, making it the
+ * process's most recent hold.
+ *
+ * @param proc The process
+ * @param res The resource
+ * @param holds The hold table
+ *
+ * @return Index of the instance in the hold table.
+ *         -1 if no instances are available
+ */
+int add_hold(struct proc_node* proc, struct res_node* res, struct hold* holds) {
+  int i = claim_res_instance(res, holds, proc->id);
+  if (i == -1) {
+    return -1;
+  }
+  holds[i].next = proc->last_hold;
+  proc->last_hold = i;
+  proc->num_holds++;
+  get_hold_counts(proc)[res->type]++;
+  return i;
+}
+
+/**
+ * Releases a process's most recent hold
+ *
+ * @param proc The process
+ * @param res The resource of the most recent hold
+ * @param holds The hold table
+ */
+void drop_last_hold(struct proc_node* proc, struct res_node* res, struct hold* holds) {
+  int i = proc->last_hold;
+  proc->last_hold = holds[i].next;
+  proc->num_holds--;
+  get_hold_counts(proc)[res->type]--;
+  free_res_instance(res, holds, i);
+}
+
+/**
+ * Hands a process's most recent hold straight to another process.
+ * The instance never goes back on the free mask, so nothing else
+ * can claim it in between.
+ *
+ * @param from The releasing process
+ * @param to The process receiving the instance
+ * @param res The resource of the most recent hold
+ * @param holds The hold table
+ *
+ * @return Index of the instance in the hold table
+ */
+int hand_off_last_hold(struct proc_node* from, struct proc_node* to, struct res_node* res, struct hold* holds) {
+  int i = from->last_hold;
+  from->last_hold = holds[i].next;
+  from->num_holds--;
+  get_hold_counts(from)[res->type]--;
+
+  holds[i].pid = to->id;
+  holds[i].next = to->last_hold;
+  to->last_hold = i;
+  to->num_holds++;
+  get_hold_counts(to)[res->type]++;
+  return i;
+}
+
+/**
+ * Releases every instance a process holds, visiting only its holds,
+ * along with its shared holds
+ *
+ * @param proc The process
+ * @param res_list The resource list
+ * @param[out] released_res Number of instances released of each resource
+ *
+ * @return Number of instances released
+ */
+int drop_all_holds(struct proc_node* proc, struct res_node* res_list, int* released_res) {
+  struct hold* holds = get_hold_table(res_list);
+  unsigned short* hold_counts = get_hold_counts(proc);
+  int num_released = 0;
+  int i = 0;
+  for (; i < num_res_types; i++) {
+    released_res[i] = 0;
+    struct res_node* res = get_res(res_list, i);
+    if (res->shareable && hold_counts[i] > 0) {
+      res->num_readers -= hold_counts[i];
+      released_res[i] = hold_counts[i];
+      num_released += hold_counts[i];
+      hold_counts[i] = 0;
+    }
+  }
+
+  int k = proc->last_hold;
+  while (k != -1) {
+    int next = holds[k].next;
+    struct res_node* res = get_res(res_list, holds[k].res_type);
+    released_res[res->type]++;
+    hold_counts[res->type] = 0;
+    free_res_instance(res, holds, k);
+    num_released++;
+    k = next;
+  }
+  proc->last_hold = -1;
+  proc->num_holds = 0;
+  return num_released;
+}
+
+/**
+ * Gives a process a hold on a shareable resource. Any number of
+ * processes can share one, so its holds are only counted: they
+ * claim no instance and aren't chained in the hold table.
+ *
+ * @param proc The process
+ * @param res The shareable resource
+ */
+void add_shared_hold(struct proc_node* proc, struct res_node* res) {
+  res->num_readers++;
+  proc->num_holds++;
+  get_hold_counts(proc)[res->type]++;
+}
+
+/**
+ * Releases one of a process's holds on a shareable resource
+ *
+ * @param proc The process
+ * @param res The shareable resource
+ */
+void drop_shared_hold(struct proc_node* proc, struct res_node* res) {
+  res->num_readers--;
+  proc->num_holds--;
+  get_hold_counts(proc)[res->type]--;
+}
+
+/**
+ * Gets the resource a process should release next: that of its
+ * most recent hold, or else a shareable resource it holds.
+ *
+ * @param proc The process
+ * @param res_list The resource list
+ *
+ * @return The resource. -1 if the process holds nothing
+ */
+int get_release_res(struct proc_node* proc, struct res_node* res_list) {
+  if (proc->last_hold != -1) {
+    return get_hold_table(res_list)[proc->last_hold].res_type;
+  }
+  unsigned short* hold_counts = get_hold_counts(proc);
+  int i = 0;
+  for (; i < num_res_types; i++) {
+    if (hold_counts[i] > 0) {
+      return i;
+    }
   }
-}
\ No newline at end of file
+  return -1;
+}
@@ -1,27 +1,70 @@
 #ifndef RESOURCE_H
 #define RESOURCE_H
 
-#define MAX_INSTANCES 10
-#define MAX_HOLDS     256
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "myclock.h"
+#include "cacheline.h"
+
+/*
+ * Resources and processes live in shared memory as arrays of
+ * variable size nodes whose stride depends on the number of
+ * resources and the instance ceiling. Use get_res() and get_proc()
+ * to index them once init_layout() has been called.
+ * -----------------------------------------------------------------*/
 
 struct res_node {
+  // Set at startup and read on every request, by children too
   unsigned int type;
   unsigned int num_instances;
-  unsigned int num_allocated;
   int shareable;
-  int held_by[MAX_INSTANCES];
+  unsigned int first_instance;  // Index of instance 0 in the hold table
+
+  // Written on every grant and release
+  CACHE_ALIGNED unsigned int num_allocated;
+  unsigned int num_readers;     // Holds on a shareable resource
+  int first_waiter;             // Head of the FIFO of blocked processes, or -1
+  int last_waiter;              // Tail of that FIFO, or -1
+  unsigned int num_waiters;     // Length of that FIFO
+  uint64_t free_mask[];         // Bit k is set while instance k is free
+};
+
+/*
+ * One entry per resource instance. The entries held by a process
+ * are chained from the most recent hold back to the oldest.
+ */
+struct hold {
+  int res_type;  // Resource this instance belongs to
+  int pid;       // Holder, or -1 while free
+  int next;      // Next older hold of the same process, or -1
 };
 
 struct proc_node {
   unsigned int id;
   int request;
-  int holds[MAX_HOLDS];
+  int num_requested;    // Instances in the set being requested, or 0
+  int preempted;        // Set when oss took holds back to break a deadlock
+  int refused;          // Set when oss turned down a try or timed request
+  int num_holds;        // Number of instances and shared holds held
+  int last_hold;        // Most recent hold in the hold table, or -1
+  int waiting_on;       // Resource the process is blocked on, or -1
+  int next_waiter;      // Next process blocked on the same resource, or -1
+  atomic_int wake_seq;  // Bumped by oss whenever it acts on this process
+  // Followed by max_claim[num_res], request_counts[num_res]
+  // and hold_counts[num_res]
 };
 
 enum res_action {
-  IDLE,     // No action to be taken (default state)
-  REQUEST,  // Request the resource
-  RELEASE   // Release the resource
+  IDLE,        // No action to be taken (default state)
+  REQUEST,     // Request the resource
+  RELEASE,     // Release the resource
+  SLEEP,       // Sleep until the given time
+  TERMINATE,   // Release everything and terminate
+  CLAIM,       // Declare the maximum claim in max_claim
+  REQUEST_SET,   // Request every instance in request_counts at once
+  TRY_REQUEST,   // Request the resource only if it can be granted now
+  REQUEST_UNTIL  // Request the resource, giving up at the given time
 };
 
 /**
@@ -32,8 +75,34 @@ struct proc_action {
   unsigned int pid;
   unsigned int res_type;
   enum res_action action;
+  struct my_clock time;  // Wake up time when sleeping, or a request's deadline
+  uint64_t sent_at;      // Wall time the process sent it, in nanoseconds
 };
 
+void init_layout(int num_res, int max_instances, int max_procs);
+size_t get_res_list_size(int total_instances);
+size_t get_proc_list_size(void);
+struct res_node* get_res(struct res_node* res_list, int i);
+struct proc_node* get_proc(struct proc_node* proc_list, int pid);
+struct hold* get_hold_table(struct res_node* res_list);
+int* get_max_claim(struct proc_node* proc);
+int* get_request_counts(struct proc_node* proc);
+unsigned short* get_hold_counts(struct proc_node* proc);
+
+void init_res_instances(struct res_node* res,
+                        unsigned int first_instance,
+                        struct hold* holds);
 int get_res_instance(struct res_node* res);
+int claim_res_instance(struct res_node* res, struct hold* holds, int pid);
+void free_res_instance(struct res_node* res, struct hold* holds, int i);
+
+int add_hold(struct proc_node* proc, struct res_node* res, struct hold* holds);
+void drop_last_hold(struct proc_node* proc, struct res_node* res, struct hold* holds);
+int hand_off_last_hold(struct proc_node* from, struct proc_node* to, struct res_node* res, struct hold* holds);
+int drop_all_holds(struct proc_node* proc, struct res_node* res_list, int* released_res);
+
+void add_shared_hold(struct proc_node* proc, struct res_node* res);
+void drop_shared_hold(struct proc_node* proc, struct res_node* res);
+int get_release_res(struct proc_node* proc, struct res_node* res_list);
 
-#endif
\ No newline at end of file
+#endif
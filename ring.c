@@ -0,0 +1,122 @@
+#include <sched.h>
+#include "futex.h"
+#include "ring.h"
+
+#define RING_MASK (ACTION_RING_SIZE - 1)
+
+/**
+ * Initializes an empty action ring.
+ *
+ * @param ring The ring in shared memory
+ */
+void init_action_ring(struct action_ring* ring) {
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->doorbell, 0);
+  atomic_init(&ring->sleeping, 0);
+  unsigned int i = 0;
+  for (; i < ACTION_RING_SIZE; i++) {
+    atomic_init(&ring->slots[i].seq, i);
+  }
+}
+
+/**
+ * Enqueues an action. Safe to call from many processes at once.
+ * Spins (yielding the CPU) while the ring is full.
+ *
+ * @param ring The ring in shared memory
+ * @param action The action to enqueue
+ * @return 0 on success
+ */
+int enqueue_action(struct action_ring* ring, struct proc_action action) {
+  struct ring_slot* slot;
+  unsigned int pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  while (1) {
+    slot = &ring->slots[pos & RING_MASK];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    int diff = (int) (seq - pos);
+    if (diff == 0) {
+      // Slot is free, try to claim it
+      if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Ring is full, wait for oss to catch up
+      sched_yield();
+      pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    } else {
+      // Another producer claimed this slot
+      pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    }
+  }
+
+  // Stamped here so request latency includes the time spent queued
+  action.sent_at = read_wall_nanosecs();
+  slot->action = action;
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+  // Ring the doorbell, waking oss only if it's asleep
+  atomic_fetch_add(&ring->doorbell, 1);
+  if (atomic_load(&ring->sleeping)) {
+    futex_wake(&ring->doorbell, 1);
+  }
+  return 0;
+}
+
+/**
+ * Dequeues an action. Only oss may call this.
+ *
+ * @param ring The ring in shared memory
+ * @param[out] action The dequeued action
+ * @return 0 on success. -1 when the ring is empty.
+ */
+int dequeue_action(struct action_ring* ring, struct proc_action* action) {
+  unsigned int pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct ring_slot* slot = &ring->slots[pos & RING_MASK];
+  unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+  if (seq != pos + 1) {
+    return -1;  // Empty, or producer hasn't finished writing
+  }
+
+  *action = slot->action;
+  atomic_store_explicit(&ring->head, pos + 1, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, pos + ACTION_RING_SIZE, memory_order_release);
+  return 0;
+}
+
+/**
+ * Sleeps until an action is enqueued. Only oss may call this.
+ * Returns early if a signal arrives.
+ *
+ * @param ring The ring in shared memory
+ */
+void wait_for_action(struct action_ring* ring) {
+  int bell = atomic_load(&ring->doorbell);
+  atomic_store(&ring->sleeping, 1);
+
+  // Recheck after announcing we're asleep so an enqueue can't slip by
+  unsigned int pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct ring_slot* slot = &ring->slots[pos & RING_MASK];
+  if (atomic_load(&slot->seq) != pos + 1) {
+    futex_wait(&ring->doorbell, bell);
+  }
+
+  atomic_store(&ring->sleeping, 0);
+}
+
+/**
+ * Counts the free slots in the ring. Other producers can only
+ * make it smaller by the time the caller acts on it.
+ *
+ * @param ring The ring in shared memory
+ * @return Number of actions that can be enqueued without waiting
+ */
+int get_ring_space(struct action_ring* ring) {
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  return ACTION_RING_SIZE - (int) (tail - head);
+}
@@ -0,0 +1,46 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include "resource.h"
+#include "cacheline.h"
+
+// Must be a power of two. Every process has at most one outstanding
+// action; with more processes than slots, producers yield while full.
+#define ACTION_RING_SIZE 256
+
+/*
+ * A slot in the action ring. The sequence number tells
+ * producers and the consumer whose turn it is to touch the slot.
+ * Each slot gets its own cache line so producers filling
+ * neighbouring slots don't contend.
+ */
+struct ring_slot {
+  atomic_uint seq;
+  struct proc_action action;
+} CACHE_ALIGNED;
+
+/*
+ * Multi-producer / single-consumer ring of process actions
+ * living in shared memory. Children enqueue, oss dequeues.
+ * ---------------------------------------------------------*/
+struct action_ring {
+  // Written by the consumer only
+  CACHE_ALIGNED atomic_uint head;  // Next slot to dequeue
+
+  // Written by producers on every enqueue. Sleeping is read on every
+  // enqueue but only written when oss goes to sleep, so it rides along.
+  CACHE_ALIGNED atomic_uint tail;  // Next slot to claim
+  atomic_int doorbell;             // Bumped on every enqueue
+  atomic_int sleeping;             // Set while oss sleeps on the doorbell
+
+  struct ring_slot slots[ACTION_RING_SIZE];
+};
+
+void init_action_ring(struct action_ring* ring);
+int enqueue_action(struct action_ring* ring, struct proc_action action);
+int dequeue_action(struct action_ring* ring, struct proc_action* action);
+void wait_for_action(struct action_ring* ring);
+int get_ring_space(struct action_ring* ring);
+
+#endif
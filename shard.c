@@ -0,0 +1,113 @@
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "metrics.h"
+#include "shard.h"
+
+/**
+ * Handles the actions handed to a shard, forever. When the last
+ * action in flight anywhere is handled, an IDLE action on the idle
+ * ring wakes oss in case it's waiting for the shards.
+ */
+static void* run_shard(void* arg) {
+  struct shard* shard = arg;
+  struct shard_pool* pool = shard->pool;
+  struct proc_action action;
+
+  // Stats page 0 is oss's main thread
+  bind_metrics(shard->index + 1);
+
+  while (1) {
+    if (dequeue_action(shard->ring, &action) == -1) {
+      wait_for_action(shard->ring);
+      continue;
+    }
+    pool->handle(action);
+    if (atomic_fetch_sub(&pool->in_flight, 1) == 1) {
+      struct proc_action idle = { 0, 0, IDLE };
+      enqueue_action(pool->idle_ring, idle);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Starts a thread for each shard.
+ *
+ * @param pool The shards
+ * @param num_shards Number of shards, and threads
+ * @param handle Called on a shard's thread for each of its actions
+ * @param idle_ring Ring to enqueue an IDLE action on whenever every
+ *                  shard has handled everything handed to it
+ */
+void start_shards(struct shard_pool* pool,
+                  int num_shards,
+                  action_handler handle,
+                  struct action_ring* idle_ring) {
+  pool->num_shards = num_shards;
+  pool->handle = handle;
+  pool->idle_ring = idle_ring;
+  atomic_init(&pool->in_flight, 0);
+  pool->shards = malloc(sizeof(struct shard) * num_shards);
+  if (pool->shards == NULL) {
+    perror("Failed to allocate shards");
+    exit(EXIT_FAILURE);
+  }
+
+  // Signals are for oss's main thread, never the shards
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  int i = 0;
+  for (; i < num_shards; i++) {
+    struct shard* shard = &pool->shards[i];
+    shard->index = i;
+    shard->pool = pool;
+    shard->ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct action_ring));
+    if (shard->ring == NULL) {
+      perror("Failed to allocate shard ring");
+      exit(EXIT_FAILURE);
+    }
+    init_action_ring(shard->ring);
+    int error = pthread_create(&shard->thread, NULL, run_shard, shard);
+    if (error != 0) {
+      fprintf(stderr, "Failed to start shard thread\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * Hands a request or release to the shard owning its resource.
+ *
+ * @param pool The shards
+ * @param action The action
+ */
+void dispatch_to_shard(struct shard_pool* pool, struct proc_action action) {
+  struct shard* shard = &pool->shards[action.res_type % pool->num_shards];
+  atomic_fetch_add(&pool->in_flight, 1);
+  enqueue_action(shard->ring, action);
+}
+
+/**
+ * @return Non-zero once every action handed out has been handled.
+ */
+int are_shards_idle(struct shard_pool* pool) {
+  return atomic_load(&pool->in_flight) == 0;
+}
+
+/**
+ * Waits until every action handed out has been handled, so the
+ * caller can touch any shard.
+ *
+ * @param pool The shards
+ */
+void wait_for_shards(struct shard_pool* pool) {
+  while (!are_shards_idle(pool)) {
+    sched_yield();
+  }
+}
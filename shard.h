@@ -0,0 +1,44 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "cacheline.h"
+#include "ring.h"
+
+/*
+ * Resource Shards
+ *
+ * Resources are split into shards by type, each owned by one worker
+ * thread. oss hands each thread the requests and releases for its
+ * resources through the thread's own action ring, so requests for
+ * resources in different shards are granted in parallel. Only the
+ * owning thread touches a resource, its waiters and its instances.
+ *-------------------------------------------------------------------*/
+
+typedef void (*action_handler)(struct proc_action action);
+
+struct shard {
+  pthread_t thread;
+  int index;
+  struct action_ring* ring;
+  struct shard_pool* pool;
+};
+
+struct shard_pool {
+  int num_shards;
+  struct shard* shards;
+  action_handler handle;
+  struct action_ring* idle_ring;  // Told when every shard goes idle
+  CACHE_ALIGNED atomic_int in_flight;  // Actions handed out but not handled
+};
+
+void start_shards(struct shard_pool* pool,
+                  int num_shards,
+                  action_handler handle,
+                  struct action_ring* idle_ring);
+void dispatch_to_shard(struct shard_pool* pool, struct proc_action action);
+int are_shards_idle(struct shard_pool* pool);
+void wait_for_shards(struct shard_pool* pool);
+
+#endif
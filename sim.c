@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include "sim.h"
+
+// Most picks in a working set requested at once
+#define WORKING_SET_PICKS 3
+
+// A step emits at most a CLAIM and a SLEEP
+#define MAX_ACTIONS_PER_STEP 2
+
+// Slots left free for the IDLE action a shard thread enqueues
+// when it goes idle
+#define RESERVED_SLOTS 1
+
+/**
+ * Sets up a simulation with no processes. The caller fills in
+ * the shared memory pointers and settings.
+ *
+ * @param sim The simulation
+ * @param max_procs Number of process IDs
+ */
+void init_simulation(struct simulation* sim, int max_procs) {
+  sim->max_procs = max_procs;
+  sim->procs = calloc(max_procs, sizeof(struct sim_proc));
+  sim->run_queue = malloc(sizeof(int) * max_procs);
+  sim->queue_head = 0;
+  sim->queue_len = 0;
+  pthread_mutex_init(&sim->queue_lock, NULL);
+}
+
+void free_simulation(struct simulation* sim) {
+  free(sim->procs);
+  free(sim->run_queue);
+  pthread_mutex_destroy(&sim->queue_lock);
+}
+
+/**
+ * Starts a process. It runs as soon as the simulation does.
+ *
+ * @param sim The simulation
+ * @param pid The ID of the process
+ * @param seed Seed of the process's random numbers
+ */
+void start_sim_proc(struct simulation* sim, int pid, unsigned int seed) {
+  struct sim_proc* p = &sim->procs[pid];
+  p->state = SIM_STARTING;
+  p->is_queued = 0;
+  p->seed = seed;
+  wake_sim_proc(sim, pid);
+}
+
+/**
+ * Marks a process runnable. Waking a process that's already
+ * runnable or done does nothing.
+ *
+ * @param sim The simulation
+ * @param pid The ID of the process
+ */
+void wake_sim_proc(struct simulation* sim, int pid) {
+  struct sim_proc* p = &sim->procs[pid];
+  pthread_mutex_lock(&sim->queue_lock);
+  if (!p->is_queued && p->state != SIM_DONE) {
+    p->is_queued = 1;
+    sim->run_queue[(sim->queue_head + sim->queue_len) % sim->max_procs] = pid;
+    sim->queue_len++;
+  }
+  pthread_mutex_unlock(&sim->queue_lock);
+}
+
+/**
+ * Stops a process oss killed.
+ *
+ * @param sim The simulation
+ * @param pid The ID of the process
+ */
+void end_sim_proc(struct simulation* sim, int pid) {
+  sim->procs[pid].state = SIM_DONE;
+}
+
+/*
+ * The helpers below mirror user.c. Keep them in step with it so
+ * both modes simulate the same workload.
+ */
+
+static int get_rand_millisecs(struct sim_proc* p, int bound) {
+  return (rand_r(&p->seed) % bound + 1) * NANOSECS_PER_MILLISEC;
+}
+
+static struct my_clock get_rand_future_time(struct simulation* sim,
+                                            struct sim_proc* p,
+                                            int bound) {
+  int rand_ms = get_rand_millisecs(p, bound);
+  return nanosecs_to_clock(read_clock_nanosecs(sim->clock) + rand_ms);
+}
+
+static int is_past_time(struct simulation* sim, struct my_clock time) {
+  return is_clock_past(sim->clock, clock_to_nanosecs(time));
+}
+
+static int should_terminate(struct sim_proc* p) {
+  int should_terminate;
+  int tries = 3;
+  int i = 0;
+
+  do {
+    should_terminate = rand_r(&p->seed) % 2;
+    i++;
+  } while (should_terminate == 1 && i < tries);
+
+  return should_terminate;
+}
+
+static void send_action(struct simulation* sim,
+                        int pid,
+                        int res_type,
+                        enum res_action kind,
+                        struct my_clock time) {
+  struct proc_action action = { pid, res_type, kind, time };
+  enqueue_action(sim->ring, action);
+}
+
+static void declare_max_claim(struct simulation* sim, struct sim_proc* p, int pid) {
+  int* max_claim = get_max_claim(get_proc(sim->proc_list, pid));
+  int i = 0;
+  for (; i < sim->num_res; i++) {
+    max_claim[i] = rand_r(&p->seed) % (get_res(sim->res_list, i)->num_instances + 1);
+  }
+  send_action(sim, pid, -1, CLAIM, (struct my_clock) { 0, 0 });
+}
+
+static int pick_res(struct simulation* sim, struct sim_proc* p, int pid) {
+  if (!sim->avoidance) {
+    return rand_r(&p->seed) % sim->num_res;
+  }
+
+  struct proc_node* proc = get_proc(sim->proc_list, pid);
+  int* max_claim = get_max_claim(proc);
+  int* request_counts = get_request_counts(proc);
+  unsigned short* hold_counts = get_hold_counts(proc);
+  int candidates[sim->num_res];
+  int num_candidates = 0;
+  int i = 0;
+  for (; i < sim->num_res; i++) {
+    if (hold_counts[i] + request_counts[i] < max_claim[i]) {
+      candidates[num_candidates++] = i;
+    }
+  }
+  return num_candidates > 0 ? candidates[rand_r(&p->seed) % num_candidates] : -1;
+}
+
+static int request_working_set(struct simulation* sim, struct sim_proc* p, int pid) {
+  struct proc_node* proc = get_proc(sim->proc_list, pid);
+  int* request_counts = get_request_counts(proc);
+  int num_picks = rand_r(&p->seed) % WORKING_SET_PICKS + 1;
+  int num_requested = 0;
+  int i = 0;
+  for (; i < num_picks; i++) {
+    int res_type = pick_res(sim, p, pid);
+    if (res_type == -1) {
+      break;
+    }
+    struct res_node* res = get_res(sim->res_list, res_type);
+    if (res->shareable || request_counts[res_type] < (int) res->num_instances) {
+      request_counts[res_type]++;
+      num_requested++;
+    }
+  }
+  if (num_requested == 0) {
+    return 0;
+  }
+
+  i = 0;
+  while (request_counts[i] == 0) {
+    i++;
+  }
+  proc->num_requested = num_requested;
+  proc->request = i;
+  send_action(sim, pid, i, REQUEST_SET, (struct my_clock) { 0, 0 });
+  return 1;
+}
+
+/**
+ * Requests one instance of a resource. While holding resources,
+ * a process with a request timeout tries or waits until a deadline.
+ */
+static void request_res(struct simulation* sim, int pid, int res_type) {
+  struct proc_node* proc = get_proc(sim->proc_list, pid);
+  struct my_clock none = { 0, 0 };
+  proc->refused = 0;
+  proc->request = res_type;
+  if (sim->request_timeout == -1 || proc->num_holds == 0) {
+    send_action(sim, pid, res_type, REQUEST, none);
+  } else if (sim->request_timeout == 0) {
+    send_action(sim, pid, res_type, TRY_REQUEST, none);
+  } else {
+    uint64_t timeout = (uint64_t) sim->request_timeout * NANOSECS_PER_MILLISEC;
+    struct my_clock deadline = nanosecs_to_clock(read_clock_nanosecs(sim->clock) + timeout);
+    send_action(sim, pid, res_type, REQUEST_UNTIL, deadline);
+  }
+}
+
+static void request_preempted_set(struct simulation* sim, int pid) {
+  struct proc_node* proc = get_proc(sim->proc_list, pid);
+  int* request_counts = get_request_counts(proc);
+  int i = 0;
+  while (request_counts[i] == 0) {
+    i++;
+  }
+  proc->preempted = 0;
+  proc->request = i;
+  send_action(sim, pid, i, REQUEST_SET, (struct my_clock) { 0, 0 });
+}
+
+/**
+ * Runs a process until it next has to wait on oss.
+ *
+ * @param sim The simulation
+ * @param pid The ID of the process
+ */
+static void step_sim_proc(struct simulation* sim, int pid) {
+  struct sim_proc* p = &sim->procs[pid];
+  struct proc_node* proc = get_proc(sim->proc_list, pid);
+  struct my_clock none = { 0, 0 };
+
+  switch (p->state) {
+    case SIM_STARTING:
+      if (sim->avoidance) {
+        declare_max_claim(sim, p, pid);
+      }
+      p->res_time = get_rand_future_time(sim, p, sim->bound);
+      p->check_time = get_rand_future_time(sim, p, 250);
+      break;
+    case SIM_SLEEPING:
+      if (is_past_time(sim, p->res_time)) {
+        int action = rand_r(&p->seed) % 2;
+        int i = -1;
+        if (sim->request_sets && proc->num_holds == 0) {
+          if (request_working_set(sim, p, pid)) {
+            p->state = SIM_REQUESTING;
+            return;
+          }
+        } else if (action != 1 || proc->num_holds == 0) {
+          i = pick_res(sim, p, pid);
+        }
+
+        if (i != -1) {
+          request_res(sim, pid, i);
+          p->state = SIM_REQUESTING;
+          return;
+        }
+        if (proc->num_holds > 0) {
+          send_action(sim, pid, get_release_res(proc, sim->res_list), RELEASE, none);
+          p->state = SIM_RELEASING;
+          return;
+        }
+        p->res_time = get_rand_future_time(sim, p, sim->bound);
+      }
+      break;
+    case SIM_REQUESTING:
+      if (proc->request != -1) {
+        return;  // Still blocked
+      }
+      if (proc->preempted) {
+        request_preempted_set(sim, pid);
+        return;
+      }
+      if (proc->refused) {
+        // Back off, giving up the most recent hold
+        send_action(sim, pid, get_release_res(proc, sim->res_list), RELEASE, none);
+        p->state = SIM_RELEASING;
+        return;
+      }
+      // Fall through
+    case SIM_RELEASING:
+      p->res_time = get_rand_future_time(sim, p, sim->bound);
+      break;
+    case SIM_DONE:
+      return;
+  }
+
+  if (is_past_time(sim, p->check_time)) {
+    if (should_terminate(p)) {
+      send_action(sim, pid, -1, TERMINATE, none);
+      p->state = SIM_DONE;
+      return;
+    }
+    p->check_time = get_rand_future_time(sim, p, 250);
+  }
+
+  // Sleep until the next thing there is to do
+  if (compare_clocks(p->res_time, p->check_time) < 0) {
+    send_action(sim, pid, -1, SLEEP, p->res_time);
+  } else {
+    send_action(sim, pid, -1, SLEEP, p->check_time);
+  }
+  p->state = SIM_SLEEPING;
+}
+
+/**
+ * Steps runnable processes, oldest first, while the action ring
+ * has room for what they send.
+ *
+ * @param sim The simulation
+ * @return Number of processes stepped
+ */
+int run_sim_procs(struct simulation* sim) {
+  int num_stepped = 0;
+  while (get_ring_space(sim->ring) >= MAX_ACTIONS_PER_STEP + RESERVED_SLOTS) {
+    pthread_mutex_lock(&sim->queue_lock);
+    if (sim->queue_len == 0) {
+      pthread_mutex_unlock(&sim->queue_lock);
+      break;
+    }
+    int pid = sim->run_queue[sim->queue_head];
+    sim->queue_head = (sim->queue_head + 1) % sim->max_procs;
+    sim->queue_len--;
+    sim->procs[pid].is_queued = 0;
+    pthread_mutex_unlock(&sim->queue_lock);
+
+    step_sim_proc(sim, pid);
+    num_stepped++;
+  }
+  return num_stepped;
+}
@@ -0,0 +1,59 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <pthread.h>
+#include "myclock.h"
+#include "resource.h"
+#include "ring.h"
+
+/*
+ * In-Process Simulation
+ *
+ * Runs the behavior of user as one small state machine per process
+ * inside oss, so a run can have far more processes than the host
+ * could fork. Each machine steps when oss wakes its process and
+ * talks to oss through the same action ring and process list.
+ *-------------------------------------------------------------------*/
+
+enum sim_state {
+  SIM_STARTING,    // Launched, hasn't run yet
+  SIM_SLEEPING,    // Waiting for a WAKE event
+  SIM_REQUESTING,  // Waiting for a request to be granted
+  SIM_RELEASING,   // Waiting for a release to be handled
+  SIM_DONE         // Terminated or killed
+};
+
+struct sim_proc {
+  enum sim_state state;
+  int is_queued;               // On the run queue
+  unsigned int seed;           // Private random number stream
+  struct my_clock res_time;    // When to request or release next
+  struct my_clock check_time;  // When to check whether to terminate
+};
+
+struct simulation {
+  struct shared_clock* clock;
+  struct res_node* res_list;
+  struct proc_node* proc_list;
+  struct action_ring* ring;
+  int num_res;
+  int bound;                   // Request / release bound in milliseconds
+  int avoidance;
+  int request_sets;            // Request working sets at once
+  int request_timeout;         // Milliseconds to wait while holding, or -1
+  struct sim_proc* procs;
+  int* run_queue;              // Processes woken by oss, oldest first
+  int queue_head;
+  int queue_len;
+  pthread_mutex_t queue_lock;  // Shard threads wake processes too
+  int max_procs;
+};
+
+void init_simulation(struct simulation* sim, int max_procs);
+void free_simulation(struct simulation* sim);
+void start_sim_proc(struct simulation* sim, int pid, unsigned int seed);
+void wake_sim_proc(struct simulation* sim, int pid);
+void end_sim_proc(struct simulation* sim, int pid);
+int run_sim_procs(struct simulation* sim);
+
+#endif
@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define INITIAL_TRACE_SIZE (1 << 20)
+
+static int trace_fd = -1;
+static char* trace_map;
+static size_t trace_size;   // Bytes mapped
+static size_t trace_end;    // Bytes written
+
+/**
+ * Opens a trace for recording.
+ *
+ * @param path The trace file
+ * @param header Settings of the run, copied to the start of the trace
+ * @return 0 on success. -1 on error.
+ */
+int open_trace(const char* path, struct trace_header* header) {
+  trace_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (trace_fd == -1) {
+    return -1;
+  }
+
+  trace_size = INITIAL_TRACE_SIZE;
+  trace_map = MAP_FAILED;
+  if (ftruncate(trace_fd, trace_size) == 0) {
+    trace_map = mmap(NULL, trace_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, trace_fd, 0);
+  }
+  if (trace_map == MAP_FAILED) {
+    close(trace_fd);
+    trace_fd = -1;
+    return -1;
+  }
+
+  memcpy(header->magic, TRACE_MAGIC, sizeof(header->magic));
+  header->length = 0;
+  memcpy(trace_map, header, sizeof(struct trace_header));
+  trace_end = sizeof(struct trace_header);
+  return 0;
+}
+
+/**
+ * Appends to the trace, doubling the file when it fills up.
+ * Does nothing when no trace is being recorded.
+ *
+ * @param data What to append
+ * @param size Size of data in bytes
+ */
+void record_trace(const void* data, size_t size) {
+  if (trace_fd == -1) {
+    return;
+  }
+
+  if (trace_end + size > trace_size) {
+    size_t new_size = trace_size * 2;
+    void* map = MAP_FAILED;
+    if (ftruncate(trace_fd, new_size) == 0) {
+      map = mremap(trace_map, trace_size, new_size, MREMAP_MAYMOVE);
+    }
+    if (map == MAP_FAILED) {
+      // Out of space. Keep what's been recorded so far.
+      close_trace();
+      return;
+    }
+    trace_map = map;
+    trace_size = new_size;
+  }
+
+  memcpy(trace_map + trace_end, data, size);
+  trace_end += size;
+}
+
+/**
+ * Finishes the trace, trimming the file to what was recorded.
+ */
+void close_trace(void) {
+  if (trace_fd == -1) {
+    return;
+  }
+  ((struct trace_header*) trace_map)->length = trace_end - sizeof(struct trace_header);
+  munmap(trace_map, trace_size);
+  ftruncate(trace_fd, trace_end);
+  close(trace_fd);
+  trace_fd = -1;
+}
+
+/**
+ * Maps a recorded trace for replay.
+ *
+ * @param path The trace file
+ * @return The trace, records following the header. NULL on error.
+ */
+struct trace_header* map_trace(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= sizeof(struct trace_header)) {
+    // Private, so fixing up the header below never touches the file
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  struct trace_header* header = map;
+  if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  // A trace cut short by a crash still has a zero length. Replay
+  // stops at the first unwritten record in that case.
+  size_t max_length = st.st_size - sizeof(struct trace_header);
+  if (header->length == 0 || header->length > max_length) {
+    header->length = max_length;
+  }
+  return header;
+}
+
+/**
+ * @return Bytes a maximum claim takes up in a trace.
+ */
+size_t get_claim_size(int num_res) {
+  size_t record_size = sizeof(struct trace_record);
+  return (num_res * sizeof(int) + record_size - 1) / record_size * record_size;
+}
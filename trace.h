@@ -0,0 +1,58 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Workload Trace
+ *
+ * A memory-mapped record of everything that drove a run of oss:
+ * the settings and seed it started with, every action it dequeued
+ * in order, and every timed event it handled. Replaying a trace
+ * reproduces the run without any child processes.
+ *------------------------------------------------------------------*/
+
+#define TRACE_MAGIC "OSSTRC3"
+
+struct trace_header {
+  char magic[8];
+  uint64_t seed;          // Seed oss was run with
+  uint64_t length;        // Bytes of records following the header
+  int32_t num_res;
+  int32_t max_instances;
+  int32_t max_procs;
+  int32_t bound;
+  int32_t avoidance;
+  int32_t batch;
+  int32_t victim_policy;
+  int32_t preemption;
+};
+
+// Zero is left unused so unwritten space reads as the end of the trace
+enum trace_type {
+  TRACE_ACTION = 1,  // An action dequeued from the action ring
+  TRACE_BATCH,       // The next kind actions were dispatched as a batch
+  TRACE_EVENT        // A timed event was popped and handled
+};
+
+/*
+ * A CLAIM action is followed by the process's maximum claim of
+ * each resource, and a REQUEST_SET action by the instances it
+ * requests of each, as ints, padded to a whole number of records.
+ */
+struct trace_record {
+  uint64_t time;     // Wake up time of a SLEEP, or when an event fired
+  int32_t type;      // enum trace_type
+  int32_t pid;
+  int32_t res_type;
+  int32_t kind;      // enum res_action, enum event_type, or batch size
+};
+
+int open_trace(const char* path, struct trace_header* header);
+void record_trace(const void* data, size_t size);
+void close_trace(void);
+struct trace_header* map_trace(const char* path);
+size_t get_claim_size(int num_res);
+
+#endif
@@ -1,33 +1,25 @@
-#include <errno.h>
 #include <stdlib.h>
-#include <signal.h>
 #include <stdio.h>
-#include <unistd.h>
 #include <string.h>
-#include <sys/time.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/stat.h>
-#include <sys/prctl.h>
-#include <time.h>
-#include "ossshm.h"
-#include "resource.h"
-#include "myclock.h"
-#include "sem.h"
-
-/*-----------------------*
- | Shared Memory Globals |
- *-----------------------*/
-struct my_clock* clock_shm          = NULL;
-struct res_node* res_list           = NULL;
-struct proc_node* proc_list         = NULL;
-struct proc_action* proc_action_shm = NULL;
-int* term_pid                       = NULL;
-
-// Globals
-int pid = -20;
-int term_sem_id = -20;
-int term_pid_id = -20;
+#include "ossclient.h"
+
+// Our connection to OSS
+struct oss_client client;
+
+// Settings from OSS
+int avoidance = 0;
+int request_sets = 0;
+int request_timeout = -1;
+
+// Most instances of each resource we'll hold at once, with avoidance
+int* max_claim = NULL;
+
+// Our random number stream. Drawn the same way as a -L sim
+// process's, so a seed makes the same workload however we're launched.
+unsigned int seed;
+
+// Most picks in a working set requested at once
+#define WORKING_SET_PICKS 3
 
 static int should_terminate() {
   int should_terminate;
@@ -35,21 +27,13 @@ static int should_terminate() {
   int i = 0;
 
   do {
-    should_terminate = rand() % 2;
+    should_terminate = rand_r(&seed) % 2;
     i++;
   } while (should_terminate == 1 && i < tries);
 
   return should_terminate;
 }
 
-static int past_initialization() {
-  return (
-    pid != -20 &&
-    term_sem_id != -20 &&
-    term_pid_id != -20
-  );
-}
-
 /**
  * Get a random amount of milliseconds
  *
@@ -57,7 +41,7 @@ static int past_initialization() {
  * @return Random amount of milliseconds in nanoseconds
  */
 int get_rand_millisecs(int bound) {
-  return (rand() % bound + 1) * NANOSECS_PER_MILLISEC;
+  return (rand_r(&seed) % bound + 1) * NANOSECS_PER_MILLISEC;
 }
 
 /**
@@ -66,12 +50,8 @@ int get_rand_millisecs(int bound) {
  * the future.
  */
 struct my_clock get_time_to_check() {
-  struct my_clock check_time;
-  check_time.secs     = clock_shm->secs;
-  check_time.nanosecs = clock_shm->nanosecs;
   int time_to_check = get_rand_millisecs(250);
-  check_time = add_nanosecs_to_clock(check_time, time_to_check);
-  return check_time;
+  return nanosecs_to_clock(oss_now(&client) + time_to_check);
 }
 
 /**
@@ -81,129 +61,126 @@ struct my_clock get_time_to_check() {
  * @param bound The maximum bound in milliseconds
  */
 struct my_clock get_rand_future_time(int bound) {
-  struct my_clock future_time;
-  future_time.secs     = clock_shm->secs;
-  future_time.nanosecs = clock_shm->nanosecs;
   int rand_ms = get_rand_millisecs(bound);
-  future_time = add_nanosecs_to_clock(future_time, rand_ms);
-  return future_time;
-}
-
-static void detach_from_shm() {
-  if (past_initialization()) {
-    // Communicate to OSS to release all resources
-    sem_wait(term_sem_id);
-      *term_pid = pid;
-      // Wait until OSS releases resources
-      while (*term_pid != -10);
-    sem_post(term_pid_id);
-  }
-
-  if (clock_shm != NULL)
-    detach_from_clock_shm(clock_shm);
-  if (res_list != NULL)
-    detach_from_res_list(res_list);
-  if (proc_list != NULL)
-    detach_from_proc_list(proc_list);
-  if (proc_action_shm != NULL)
-    detach_from_proc_action(proc_action_shm);
-  if (term_pid != NULL)
-    detach_from_int_shm(term_pid);
+  return nanosecs_to_clock(oss_now(&client) + rand_ms);
 }
 
 static int is_past_time(struct my_clock myclock) {
-  return (clock_shm->secs     >= myclock.secs &&
-          clock_shm->nanosecs >= myclock.nanosecs);
+  return oss_now(&client) >= clock_to_nanosecs(myclock);
 }
 
-int has_resource(int pid) {
-  return (proc_list + pid)->holds[0] != -1 ? 1 : 0;
+/**
+ * Declare a random maximum claim of each resource to OSS
+ *
+ * @param num_res Number of resources
+ */
+static void declare_max_claim(int num_res) {
+  max_claim = malloc(sizeof(int) * num_res);
+  int i = 0;
+  for (; i < num_res; i++) {
+    max_claim[i] = rand_r(&seed) % (get_res(client.res_list, i)->num_instances + 1);
+  }
+  oss_declare_claim(&client, max_claim);
 }
 
-static void request_res(int pid, int num_res) {
-  int i = rand() % num_res;
-  struct res_node* res = res_list + i;
-
-  // fprintf(stderr, "P%d requesting R%d\n", pid, res->type);
-  
-  // Make request
-  proc_action_shm->pid = pid;
-  proc_action_shm->res_type = res->type;
-  proc_action_shm->action = REQUEST;
-
-  int num_available = res->num_instances - res->num_allocated;
-  if (num_available == 0) {
-    // fprintf(stderr, "P%02d waiting. No more of R%02d left.\n", pid, res->type);
-
-    while (1); // Wait if no more instances are available
+/**
+ * Pick a random resource to request. With deadlock avoidance,
+ * only resources still within the maximum claim are picked.
+ *
+ * @param picked Instances of each resource already picked for a set
+ * @return The resource type, or -1 if the claim is used up
+ */
+static int pick_res(int num_res, int* picked) {
+  if (!avoidance) {
+    return rand_r(&seed) % num_res;
   }
 
-
-  // Find next available index
-  int k = get_res_instance(res);
-
-  if (k == -1) {  // Exceeded held_by array
-    fprintf(stderr, "R%02d already held by 10 resources\n", res->type);
-    detach_from_shm();
-    exit(EXIT_FAILURE);
+  int candidates[num_res];
+  int num_candidates = 0;
+  int i = 0;
+  for (; i < num_res; i++) {
+    if (oss_num_held(&client, i) + picked[i] < max_claim[i]) {
+      candidates[num_candidates++] = i;
+    }
   }
-
-  // Wait until request is granted
-  while (res->held_by[k] == -1);
+  return num_candidates > 0 ? candidates[rand_r(&seed) % num_candidates] : -1;
 }
 
 /**
- * Release the last request resource
+ * Request a random working set of up to WORKING_SET_PICKS
+ * instances, never more of a resource than there are, all at once
  *
- * @param pid The ID of the process releasing the resource
+ * @return 0 if there was nothing left to request
  */
-static void release_res(int pid) {
-  if (has_resource(pid)) {
-    struct proc_node* proc = proc_list + pid;
-    int i = 0;
-    while (proc->holds[i] != -1) {
-      i++;
+static int request_working_set(int num_res) {
+  int picked[num_res];
+  memset(picked, 0, sizeof(picked));
+  int num_picks = rand_r(&seed) % WORKING_SET_PICKS + 1;
+  int i = 0;
+  for (; i < num_picks; i++) {
+    int res_type = pick_res(num_res, picked);
+    if (res_type == -1) {
+      break;
     }
-    i--;
+    struct res_node* res = get_res(client.res_list, res_type);
+    if (res->shareable || picked[res_type] < (int) res->num_instances) {
+      picked[res_type]++;
+    }
+  }
+  return oss_acquire_many(&client, picked);
+}
 
-    // Make request
-    proc_action_shm->pid = pid;
-    proc_action_shm->res_type = proc->holds[i];
-    proc_action_shm->action = RELEASE;
+/**
+ * Request a random resource. With a request timeout, a process
+ * holding resources backs off instead of waiting on the request
+ * as long as it takes: when the request isn't granted in time it
+ * releases its most recent hold, so others can use it. A process
+ * holding nothing can't be part of a deadlock, so it just waits.
+ *
+ * @return 0 if there was nothing left to request
+ */
+static int request_res(int num_res) {
+  int picked[num_res];
+  memset(picked, 0, sizeof(picked));
+  int i = pick_res(num_res, picked);
+  if (i == -1) {
+    return 0;
+  }
 
-    // Wait until request is granted
-    while (proc->holds[i] != -1);
+  int is_granted = 1;
+  if (request_timeout == -1 || oss_num_holds(&client) == 0) {
+    oss_acquire(&client, i);
+  } else if (request_timeout == 0) {
+    is_granted = oss_try_acquire(&client, i);
+  } else {
+    uint64_t timeout = (uint64_t) request_timeout * NANOSECS_PER_MILLISEC;
+    is_granted = oss_acquire_until(&client, i, nanosecs_to_clock(oss_now(&client) + timeout));
+  }
 
+  if (!is_granted) {
+    oss_release(&client);
   }
+  return 1;
 }
 
 int main(int argc, char* argv[]) {
-  // TODO: Reduce the number of args by putting them into a struct
-  if (argc != 11) {
-    fprintf(stderr, "Invalid number of arguments\n");
+  // user pid shm_fd [pool_slot]
+  if (oss_attach(&client, argc, argv) == -1) {
     return EXIT_FAILURE;
   }
-
-  srand(time(NULL));
-
-  pid                       = atoi(argv[1]);
-  const int bound           = atoi(argv[2]);
-  const int num_res         = atoi(argv[3]);
-  const int clock_id        = atoi(argv[4]);
-  const int res_list_id     = atoi(argv[5]);
-  const int proc_list_id    = atoi(argv[6]);
-  const int proc_action_id  = atoi(argv[7]);
-  term_pid_id               = atoi(argv[8]);
-  const int sem_id          = atoi(argv[9]);
-  term_sem_id               = atoi(argv[10]);
-
-  signal(SIGTERM, detach_from_shm);
-
-  clock_shm = attach_to_clock_shm(clock_id);
-  res_list = attach_to_res_list(res_list_id);
-  proc_list = attach_to_proc_list(proc_list_id);
-  proc_action_shm = attach_to_proc_action(proc_action_id);
-  term_pid = attach_to_int_shm(term_pid_id);
+  const int bound   = client.shm->bound;
+  const int num_res = client.shm->num_res;
+  avoidance         = client.shm->avoidance;
+  // A set can span the resources of several threads
+  request_sets      = client.shm->num_threads == 0;
+  request_timeout   = client.shm->request_timeout;
+
+  // Seeded from oss so a run can be repeated with the same seed
+  seed = client.shm->seed + client.pid;
+
+  if (avoidance) {
+    declare_max_claim(num_res);
+  }
 
   // When should process request / release a resource
   struct my_clock res_time = get_rand_future_time(bound);
@@ -212,18 +189,25 @@ int main(int argc, char* argv[]) {
 
   struct my_clock check_time = get_rand_future_time(250);
   while (!is_terminating) {
+    // Sleep until the next thing we have to do
+    if (compare_clocks(res_time, check_time) < 0) {
+      oss_sleep_until(&client, res_time);
+    } else {
+      oss_sleep_until(&client, check_time);
+    }
 
     // Every 1 to bound ms, check should request /
     // release a resource
     if (is_past_time(res_time)) {
-      sem_wait(sem_id);
-        int action = rand() % 2;
-        if (action == 1 && has_resource(pid)) {
-          release_res(pid);
-        } else {
-          request_res(pid, num_res);
-        }
-      sem_post(sem_id);
+      int action = rand_r(&seed) % 2;
+      int has_resource = oss_num_holds(&client) > 0;
+      if (action == 1 && has_resource) {
+        oss_release(&client);
+      } else if (request_sets && !has_resource) {
+        request_working_set(num_res);
+      } else if (!request_res(num_res)) {
+        oss_release(&client);
+      }
       res_time = get_rand_future_time(bound);
     }
 
@@ -234,7 +218,8 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  detach_from_shm();
+  // OSS releases everything we hold, then kills us
+  oss_detach(&client);
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "victim.h"
+
+/*
+ * What a cost function gets to look at
+ */
+struct candidates {
+  struct victim_selector* sel;
+  struct wait_graph* graph;
+  struct res_node* res_list;
+  struct proc_node* proc_list;
+  uint64_t now;
+};
+
+typedef int64_t (*victim_cost)(struct candidates* c, int pid);
+
+static const char* policy_names[NUM_VICTIM_POLICIES] = {
+  "lifo",
+  "holds",
+  "youngest",
+  "work",
+  "minset"
+};
+
+/**
+ * @return The policy with the given name, or -1 if there's none.
+ */
+int parse_victim_policy(const char* name) {
+  int i = 0;
+  for (; i < NUM_VICTIM_POLICIES; i++) {
+    if (strcmp(name, policy_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char* get_victim_policy_name(enum victim_policy policy) {
+  return policy_names[policy];
+}
+
+static uint64_t* alloc_times(int num_procs) {
+  uint64_t* times = calloc(num_procs, sizeof(uint64_t));
+  if (times == NULL) {
+    perror("Failed to allocate victim selector");
+    exit(EXIT_FAILURE);
+  }
+  return times;
+}
+
+/**
+ * Initializes a victim selector.
+ *
+ * @param sel The selector
+ * @param policy How to pick victims
+ * @param num_procs Number of process IDs
+ */
+void init_victim_selector(struct victim_selector* sel,
+                          enum victim_policy policy,
+                          int num_procs) {
+  sel->policy = policy;
+  sel->started_at = alloc_times(num_procs);
+  sel->blocked_since = alloc_times(num_procs);
+  sel->time_blocked = alloc_times(num_procs);
+}
+
+void free_victim_selector(struct victim_selector* sel) {
+  free(sel->started_at);
+  free(sel->blocked_since);
+  free(sel->time_blocked);
+}
+
+void note_proc_started(struct victim_selector* sel, int pid, uint64_t now) {
+  sel->started_at[pid] = now;
+  sel->time_blocked[pid] = 0;
+}
+
+void note_proc_blocked(struct victim_selector* sel, int pid, uint64_t now) {
+  sel->blocked_since[pid] = now;
+}
+
+void note_proc_unblocked(struct victim_selector* sel, int pid, uint64_t now) {
+  sel->time_blocked[pid] += now - sel->blocked_since[pid];
+}
+
+/**
+ * Gets the work killing a process would throw away: the simulated
+ * time it has been running, less the time it spent blocked.
+ *
+ * @param sel The selector
+ * @param pid The process
+ * @param is_blocked Nonzero if the process is blocked right now
+ * @param now The simulated time in nanoseconds
+ * @return The work lost in simulated nanoseconds
+ */
+uint64_t get_work_lost(struct victim_selector* sel, int pid, int is_blocked, uint64_t now) {
+  uint64_t blocked = sel->time_blocked[pid];
+  if (is_blocked) {
+    blocked += now - sel->blocked_since[pid];
+  }
+  return now - sel->started_at[pid] - blocked;
+}
+
+static int64_t cost_lifo(struct candidates* c, int pid) {
+  return -(int64_t) c->graph->blocked_at[pid];
+}
+
+static int64_t cost_holds(struct candidates* c, int pid) {
+  return get_proc(c->proc_list, pid)->num_holds;
+}
+
+static int64_t cost_youngest(struct candidates* c, int pid) {
+  return -(int64_t) c->sel->started_at[pid];
+}
+
+static int64_t cost_work(struct candidates* c, int pid) {
+  return get_work_lost(c->sel, pid, 1, c->now);
+}
+
+/**
+ * Killing whichever process leaves the fewest deadlocked, one at a
+ * time, greedily approximates the smallest set of kills that breaks
+ * every cycle. Finding the exact set is NP-hard.
+ */
+static int64_t cost_min_set(struct candidates* c, int pid) {
+  return count_deadlocked_without(c->graph, c->res_list, c->proc_list, pid);
+}
+
+static const victim_cost costs[NUM_VICTIM_POLICIES] = {
+  cost_lifo,
+  cost_holds,
+  cost_youngest,
+  cost_work,
+  cost_min_set
+};
+
+/**
+ * Picks the deadlocked process to kill next.
+ *
+ * @param sel The selector
+ * @param graph The wait-for graph
+ * @param res_list The resource list
+ * @param proc_list The process list
+ * @param deadlocked IDs of the deadlocked processes
+ * @param num_deadlocked Number of deadlocked processes, at least one
+ * @param now The simulated time in nanoseconds
+ * @return The ID of the process to kill
+ */
+int select_victim(struct victim_selector* sel,
+                  struct wait_graph* graph,
+                  struct res_node* res_list,
+                  struct proc_node* proc_list,
+                  int* deadlocked,
+                  int num_deadlocked,
+                  uint64_t now) {
+  struct candidates c = { sel, graph, res_list, proc_list, now };
+  victim_cost cost = costs[sel->policy];
+
+  int victim = deadlocked[0];
+  int64_t best_cost = cost(&c, victim);
+  int i = 1;
+  for (; i < num_deadlocked; i++) {
+    int pid = deadlocked[i];
+    int64_t pid_cost = cost(&c, pid);
+    if (pid_cost < best_cost ||
+        (pid_cost == best_cost && graph->blocked_at[pid] > graph->blocked_at[victim])) {
+      victim = pid;
+      best_cost = pid_cost;
+    }
+  }
+  return victim;
+}
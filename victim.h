@@ -0,0 +1,53 @@
+#ifndef VICTIM_H
+#define VICTIM_H
+
+#include <stdint.h>
+#include "deadlock.h"
+#include "resource.h"
+
+/*
+ * Deadlock Victim Selection
+ *
+ * Picks which deadlocked process to kill next. Each policy is a cost
+ * over the deadlocked processes, and the cheapest one is killed;
+ * ties go to the most recently blocked. The selector also tracks how
+ * long each process has run and been blocked, the work a kill
+ * throws away.
+ *-----------------------------------------------------------------*/
+
+enum victim_policy {
+  VICTIM_LIFO,      // Most recently blocked
+  VICTIM_HOLDS,     // Fewest instances held
+  VICTIM_YOUNGEST,  // Most recently started
+  VICTIM_WORK,      // Least simulated work lost
+  VICTIM_MIN_SET,   // Leaves the fewest processes deadlocked
+  NUM_VICTIM_POLICIES
+};
+
+struct victim_selector {
+  enum victim_policy policy;
+  uint64_t* started_at;     // When each process started, in simulated ns
+  uint64_t* blocked_since;  // When each blocked process last blocked
+  uint64_t* time_blocked;   // Time each process has spent blocked before that
+};
+
+int parse_victim_policy(const char* name);
+const char* get_victim_policy_name(enum victim_policy policy);
+
+void init_victim_selector(struct victim_selector* sel,
+                          enum victim_policy policy,
+                          int num_procs);
+void free_victim_selector(struct victim_selector* sel);
+void note_proc_started(struct victim_selector* sel, int pid, uint64_t now);
+void note_proc_blocked(struct victim_selector* sel, int pid, uint64_t now);
+void note_proc_unblocked(struct victim_selector* sel, int pid, uint64_t now);
+uint64_t get_work_lost(struct victim_selector* sel, int pid, int is_blocked, uint64_t now);
+int select_victim(struct victim_selector* sel,
+                  struct wait_graph* graph,
+                  struct res_node* res_list,
+                  struct proc_node* proc_list,
+                  int* deadlocked,
+                  int num_deadlocked,
+                  uint64_t now);
+
+#endif